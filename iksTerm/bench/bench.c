@@ -0,0 +1,590 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#ifdef BENCH_RENDER
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#endif
+
+#include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+#include <term_ring.h>
+#include <term_record.h>
+#include <term_utf8.h>
+#include <term_parser.h>
+#include <term_scan.h>
+#include <term_select.h>
+#include <term_screen.h>
+#include <term_stats.h>
+#ifdef BENCH_RENDER
+#include <term.h>
+#endif
+
+/**
+ * @brief Defines the size of each generated corpus.
+ */
+#define BENCH_CORPUS_SIZE (4 * 1024 * 1024)
+/**
+ * @brief Defines the default number of times corpus is replayed.
+ */
+#define BENCH_REPEAT 4
+/**
+ * @brief Defines history budgets in KiB swept by resize and search benchmarks when `--history` isn't set.
+ */
+#define BENCH_HISTORIES {1024, 16384, 131072}
+
+/*!
+ * @struct bench_buffer_t
+ * @brief Growing byte buffer corpus is generated or read into
+ */
+typedef struct bench_buffer_t {
+    char *data;     ///< Bytes of corpus
+    size_t length;  ///< Number of used bytes
+    size_t capacity;///< Number of allocated bytes
+} bench_buffer_t;
+
+/*!
+ * @struct bench_options_t
+ * @brief Options of benchmark run
+ */
+typedef struct bench_options_t {
+    int width, height; ///< Size of screen in cells
+    int history_size;  ///< History budget in KiB
+    bool history_set;  ///< History budget is set by option
+    int repeat;        ///< Number of times each corpus is replayed
+    size_t chunk;      ///< Bytes passed to the parser at once, like one read from PTY
+    const char *only;  ///< Name of the only built-in corpus to run, NULL for all
+    const char *kernel;///< Name of printable scan kernel, NULL for the fastest one
+    bool render;       ///< Draw frame after every chunk
+    int resizes;       ///< Number of resizes measured instead of throughput, 0 for none
+    const char *search;///< Query searched over full history instead of throughput, NULL for none
+} bench_options_t;
+
+/*!
+ * \brief Append bytes to buffer
+ */
+static void bench_append(bench_buffer_t *buffer, const char *data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+        while (capacity < buffer->length + length)
+            capacity *= 2;
+        char *data_new = realloc(buffer->data, capacity);
+        if (!data_new) {
+            perror("realloc");
+            exit(1);
+        }
+        buffer->data = data_new;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+/*!
+ * \brief Append formatted line to buffer
+ */
+static void bench_printf(bench_buffer_t *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void bench_printf(bench_buffer_t *buffer, const char *format, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0)
+        bench_append(buffer, line, MIN((size_t) length, sizeof(line) - 1));
+}
+
+/*!
+ * \brief Generate log lines of plain ASCII text
+ */
+static void bench_corpus_plain(bench_buffer_t *buffer, const bench_options_t *options) {
+    (void) options;
+    static const char *levels[] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    for (unsigned i = 0; buffer->length < BENCH_CORPUS_SIZE; i++)
+        bench_printf(buffer,
+                     "2024-05-01 12:%02u:%02u.%03u %-5s worker-%u: processed request id=%u path=/api/v1/items/%u in %u ms\r\n",
+                     (i / 60000) % 60, (i / 1000) % 60, i % 1000, levels[i % 4], i % 16, i * 7919, i % 1000, i % 97);
+}
+
+/*!
+ * \brief Generate listing with SGR color around every name, like `ls --color`
+ */
+static void bench_corpus_color(bench_buffer_t *buffer, const bench_options_t *options) {
+    (void) options;
+    for (unsigned i = 0; buffer->length < BENCH_CORPUS_SIZE; i++)
+        bench_printf(buffer,
+                     "\033[0m\033[01;34mdirectory_%u\033[0m  \033[01;32mscript_%u.sh\033[0m  \033[01;31marchive_%u.tar.gz\033[0m"
+                     "  \033[38;5;%um file_%u.txt\033[0m  \033[38;2;%u;%u;%um image_%u.png\033[0m\r\n",
+                     i, i, i, i % 256, i, i % 256, (i * 3) % 256, (i * 7) % 256, i);
+}
+
+/*!
+ * \brief Generate full-screen redraws with cursor addressing and line erase, like vim scrolling a file
+ */
+static void bench_corpus_vim(bench_buffer_t *buffer, const bench_options_t *options) {
+    int width = options->width;
+    int height = options->height;
+    for (unsigned frame = 0; buffer->length < BENCH_CORPUS_SIZE; frame++) {
+        bench_printf(buffer, "\033[?25l\033[H");
+        for (int y = 0; y < height - 1; y++) {
+            unsigned line = frame + (unsigned) y;
+            bench_printf(buffer,
+                         "\033[%d;1H\033[33m%5u \033[m\033[32mstatic\033[m \033[36mint\033[m function_%u(\033[36mint\033[m "
+                         "value) { \033[35mreturn\033[m value * %u; }\033[K",
+                         y + 1, line, line, line % 13);
+        }
+        bench_printf(buffer, "\033[%d;1H\033[7m bench.c [+]  line %u of 100000%*s\033[m\033[%d;7H\033[?25h", height, frame,
+                     MAX(width - 40, 0), "", height / 2);
+    }
+}
+
+/*!
+ * \brief Generate pager session on alternate screen: region scrolling forth and back, status line and re-entering
+ */
+static void bench_corpus_pager(bench_buffer_t *buffer, const bench_options_t *options) {
+    int height = options->height;
+    for (unsigned page = 0; buffer->length < BENCH_CORPUS_SIZE; page++) {
+        bench_printf(buffer, "\033[?1049h\033[1;%dr\033[H", height - 1);
+        for (unsigned i = 0; i < 256; i++) {
+            if (i % 8 == 7)
+                bench_printf(buffer, "\033[H\033M\033[32m%7u\033[m previous line of the page\033[K", page * 256 + i);
+            else
+                bench_printf(buffer, "\033[%d;1H\n\033[33m%7u\033[m next line of the page, it scrolls the region up\033[K",
+                             height - 1, page * 256 + i);
+            bench_printf(buffer, "\033[%d;1H\033[7m page %u line %u \033[m\033[K", height, page, i);
+            if (i % 32 == 31)
+                bench_printf(buffer, "\033[4;1H\033[3L\033[8;1H\033[2M");
+        }
+        bench_printf(buffer, "\033[r\033[?1049l");
+    }
+}
+
+/*!
+ * \brief Generate output of `yes`
+ */
+static void bench_corpus_yes(bench_buffer_t *buffer, const bench_options_t *options) {
+    (void) options;
+    while (buffer->length < BENCH_CORPUS_SIZE)
+        bench_append(buffer, "y\r\ny\r\ny\r\ny\r\ny\r\ny\r\ny\r\ny\r\n", 24);
+}
+
+/*!
+ * \brief Generate UTF-8 text: Cyrillic, box drawing and double-width CJK
+ */
+static void bench_corpus_utf8(bench_buffer_t *buffer, const bench_options_t *options) {
+    (void) options;
+    for (unsigned i = 0; buffer->length < BENCH_CORPUS_SIZE; i++)
+        bench_printf(buffer,
+                     "│ %6u │ Съешь же ещё этих мягких французских булок │ 日本語のテキスト │ ─────── │ naïve café │\r\n", i);
+}
+
+/*!
+ * @struct bench_corpus_t
+ * @brief Built-in corpus and its generator
+ */
+typedef struct bench_corpus_t {
+    const char *name;                                                        ///< Name of corpus
+    void (*generate)(bench_buffer_t *buffer, const bench_options_t *options);///< Fills buffer with corpus
+} bench_corpus_t;
+
+static const bench_corpus_t bench_corpora[] = {
+    {"plain", bench_corpus_plain}, {"color", bench_corpus_color}, {"vim", bench_corpus_vim},
+    {"pager", bench_corpus_pager}, {"yes", bench_corpus_yes},     {"utf8", bench_corpus_utf8},
+};
+
+/*!
+ * \brief Read output records of log made by `iksTerm --record` into buffer, timing and resizes are dropped
+ */
+static bool bench_read_record(bench_buffer_t *buffer, const char *path) {
+    term_replay_t replay;
+    if (!replay_open(&replay, path))
+        return false;
+    record_type_t type;
+    while ((type = replay_next(&replay)) != RECORD_END)
+        if (type == RECORD_OUTPUT)
+            bench_append(buffer, replay.output, replay.output_length);
+    replay_close(&replay);
+    return true;
+}
+
+/*!
+ * \brief Read whole file into buffer, record log is unpacked into output it holds
+ */
+static bool bench_read_file(bench_buffer_t *buffer, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    char data[65536];
+    size_t n;
+    while ((n = fread(data, 1, sizeof(data), file)) > 0)
+        bench_append(buffer, data, n);
+    bool ok = !ferror(file);
+    if (!ok)
+        perror(path);
+    fclose(file);
+    if (ok && buffer->length >= RECORD_MAGIC_SIZE && !memcmp(buffer->data, RECORD_MAGIC, RECORD_MAGIC_SIZE)) {
+        buffer->length = 0;
+        ok = bench_read_record(buffer, path);
+    }
+    return ok;
+}
+
+/*!
+ * \brief Get monotonic time in nanoseconds
+ */
+static uint64_t bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*!
+ * \brief Get peak resident set size in KiB
+ */
+static long bench_peak_rss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1) {
+        perror("getrusage");
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+#ifdef BENCH_RENDER
+/*!
+ * \brief Open window on display (e.g. Xvfb) to render corpus into
+ */
+static bool bench_render_init(term_t *term, screen_t *screen, const bench_options_t *options) {
+    *term = (term_t) {
+        .model = screen,
+        .option_width = options->width,
+        .option_height = options->height,
+        .history_size = options->history_size,
+    };
+    if (!term_init(term))
+        return false;
+    XSync(term->display, False);
+    return true;
+}
+
+/*!
+ * \brief Close window and free renderer
+ */
+static void bench_render_destroy(term_t *term) {
+    XFreePixmap(term->display, term->back_buffer);
+    XFreeGC(term->display, term->graphics_context);
+    XDestroyWindow(term->display, term->window);
+    XCloseDisplay(term->display);
+    free(term->glyph_cache);
+    free(term->draw_line);
+    free(term->draw_line16);
+    free(term->view_chars);
+    free(term->view_attrs);
+}
+#endif
+
+/*!
+ * \brief Replay corpus through screen model and print one line of results
+ */
+static bool bench_run(const char *name, const bench_buffer_t *corpus, const bench_options_t *options) {
+    screen_t screen = {};
+    term_palette_t palette;
+#ifdef BENCH_RENDER
+    term_t term;
+    if (options->render && !bench_render_init(&term, &screen, options))
+        return false;
+#endif
+    if (!options->render) {
+        palette_init(&palette);
+        if (!screen_init(&screen, &palette, options->width, options->height, (size_t) options->history_size * 1024))
+            return false;
+    }
+    // Parser picks the fastest kernel when its tables are built by the first screen
+    if (options->kernel)
+        term_scan_select(options->kernel);
+
+    uint64_t begin = bench_now();
+    for (int r = 0; r < options->repeat; r++) {
+        for (size_t offset = 0; offset < corpus->length; offset += options->chunk) {
+            screen_output(&screen, corpus->data + offset, MIN(options->chunk, corpus->length - offset));
+            // Replies aren't read by anyone
+            screen.answer_length = 0;
+#ifdef BENCH_RENDER
+            if (options->render)
+                term_draw(&term);
+#endif
+        }
+    }
+#ifdef BENCH_RENDER
+    // Count time X server spends on queued requests
+    if (options->render)
+        XSync(term.display, False);
+#endif
+    uint64_t elapsed = bench_now() - begin;
+
+    double bytes = (double) corpus->length * options->repeat;
+    double seconds = (double) elapsed / 1e9;
+    printf("%-12s %10.1f %10.1f %10.2f %10lu", name, bytes / (1024 * 1024), bytes / (1024 * 1024) / seconds,
+           (double) elapsed / bytes, screen.stats_scrolls);
+#ifdef BENCH_RENDER
+    if (options->render) {
+        printf(" %8lu %10.1f", term.stats_frames,
+               term.stats_frames ? (double) term.stats_requests / (double) term.stats_frames : 0.0);
+        bench_render_destroy(&term);
+    }
+#endif
+    printf(" %10ld\n", bench_peak_rss());
+
+    screen_destroy(&screen);
+    return true;
+}
+
+/*!
+ * \brief Fill screen and history up to budget with corpus, then measure resizes alternating between two sizes
+ *  Wide size wraps nothing and narrow one wraps most lines, so every resize reflows the whole screen.
+ */
+static bool bench_resize(const bench_buffer_t *corpus, const bench_options_t *options, int history_size) {
+    screen_t screen = {};
+    term_palette_t palette;
+    palette_init(&palette);
+    if (!screen_init(&screen, &palette, options->width, options->height, (size_t) history_size * 1024))
+        return false;
+    do {
+        screen_output(&screen, corpus->data, corpus->length);
+        screen.answer_length = 0;
+    } while (screen.history.chunk_count < screen.history.chunk_limit);
+
+    int narrow_width = MAX(options->width * 2 / 3, 1);
+    int narrow_height = MAX(options->height - options->height / 4, 1);
+    uint64_t begin = bench_now();
+    for (int i = 0; i < options->resizes; i++) {
+        bool narrow = i % 2 == 0;
+        if (!screen_resize(&screen, narrow ? narrow_width : options->width, narrow ? narrow_height : options->height)) {
+            screen_destroy(&screen);
+            return false;
+        }
+    }
+    uint64_t elapsed = bench_now() - begin;
+
+    printf("%-12d %10zu %10d %10.2f %10ld\n", history_size, screen.history.line_count, options->resizes,
+           (double) elapsed / 1e3 / options->resizes, bench_peak_rss());
+    screen_destroy(&screen);
+    return true;
+}
+
+/*!
+ * \brief Fill screen and history up to budget with corpus, then measure typing of query and incremental search
+ *  Query is typed character by character, each one filters matches and finds the nearest one like the search bar.
+ *  Then corpus is replayed once more and only its new lines are scanned.
+ */
+static bool bench_search(const bench_buffer_t *corpus, const bench_options_t *options, int history_size) {
+    screen_t screen = {};
+    term_palette_t palette;
+    palette_init(&palette);
+    if (!screen_init(&screen, &palette, options->width, options->height, (size_t) history_size * 1024))
+        return false;
+    do {
+        screen_output(&screen, corpus->data, corpus->length);
+        screen.answer_length = 0;
+    } while (screen.history.chunk_count < screen.history.chunk_limit);
+
+    screen.search.active = true;
+    utf8_decoder_t decoder = {};
+    uint64_t begin = bench_now();
+    for (const char *c = options->search; *c; c++) {
+        uint32_t codepoint = 0;
+        if (utf8_decode(&decoder, (unsigned char) *c, &codepoint) == UTF8_DONE && search_type(&screen, codepoint))
+            search_next(&screen, true);
+    }
+    uint64_t typed = bench_now() - begin;
+
+    size_t lines_before = screen.history.line_total;
+    screen_output(&screen, corpus->data, corpus->length);
+    screen.answer_length = 0;
+    size_t lines = screen.history.line_total - lines_before;
+    begin = bench_now();
+    search_update(&screen);
+    uint64_t updated = bench_now() - begin;
+
+    printf("%-12d %10zu %10zu %10.2f %10.1f %10ld\n", history_size, screen.history.line_count, search_count(&screen),
+           (double) typed / 1e6, lines ? (double) updated / (double) lines : 0.0, bench_peak_rss());
+    screen_destroy(&screen);
+    return true;
+}
+
+/*!
+ * \brief Prints help to stdout
+ */
+static void bench_help() {
+    fprintf(stdout,
+            "Usage: iksBench [OPTION...] [FILE...]\n"
+            "Replay recorded output through " TERM_NAME " screen model without display and report throughput.\n"
+            "Without files built-in corpora are generated: plain, color, vim, pager, yes, utf8.\n"
+            "Files are raw output or logs made by `" TERM_NAME " --record`.\n"
+            "\n"
+            "   -h, --help                          Show help.\n"
+            "   -wNUM, --width=NUM                  Set width of screen in cells. Default is 120.\n"
+            "   -lNUM, --length=NUM                 Set length of screen in cells. Default is 60.\n"
+            "   -HNUM, --history=NUM                Set scrollback memory limit in KiB. Default is 4096.\n"
+            "   -nNUM, --repeat=NUM                 Replay each corpus NUM times. Default is 4.\n"
+            "   -bNUM, --chunk=NUM                  Pass NUM bytes to parser at once. Default is 4096.\n"
+            "   -cNAME, --corpus=NAME               Run only built-in corpus NAME.\n"
+            "   -kNAME, --kernel=NAME               Use printable scan kernel NAME (scalar, sse2, avx2).\n"
+            "   -zNUM, --resize=NUM                 Measure NUM reflowing resizes of screen with full history instead.\n"
+            "                                       History budgets 1024, 16384, 131072 KiB are swept unless -H is set.\n"
+            "   -sTEXT, --search=TEXT               Measure search of TEXT over full history instead, budgets are swept too.\n"
+#ifdef BENCH_RENDER
+            "   -R, --render                        Draw frame after every chunk on $DISPLAY (e.g. Xvfb).\n"
+#endif
+            "\n"
+            "Columns: corpus, replayed MiB, MiB/s, ns/byte, scrolled lines,"
+#ifdef BENCH_RENDER
+            " frames, X requests per frame,"
+#endif
+            " peak RSS in KiB.\n"
+            "Resize columns: history KiB, history lines, resizes, us/resize, peak RSS in KiB.\n"
+            "Search columns: history KiB, history lines, matches, ms to type query, ns/line of incremental update,\n"
+            "                peak RSS in KiB.\n");
+}
+
+int main(int argc, char **argv) {
+    bench_options_t options = {
+        .width = DEFAULT_WIDTH,
+        .height = DEFAULT_HEIGHT,
+        .history_size = HISTORY_SIZE,
+        .repeat = BENCH_REPEAT,
+        .chunk = READ_BUFFER_SIZE,
+    };
+    // Scan options
+    while (true) {
+        static struct option long_options[] = {{"help", no_argument, 0, 'h'},
+                                               {"width", required_argument, 0, 'w'},
+                                               {"length", required_argument, 0, 'l'},
+                                               {"history", required_argument, 0, 'H'},
+                                               {"repeat", required_argument, 0, 'n'},
+                                               {"chunk", required_argument, 0, 'b'},
+                                               {"corpus", required_argument, 0, 'c'},
+                                               {"kernel", required_argument, 0, 'k'},
+                                               {"render", no_argument, 0, 'R'},
+                                               {"resize", required_argument, 0, 'z'},
+                                               {"search", required_argument, 0, 's'},
+                                               {0, 0, 0, 0}};
+        int c = getopt_long(argc, argv, "hw:l:H:n:b:c:k:Rz:s:", long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'h':
+                bench_help();
+                return 0;
+            case 'w':
+                options.width = MAX(atoi(optarg), 1);
+                break;
+            case 'l':
+                options.height = MAX(atoi(optarg), 1);
+                break;
+            case 'H':
+                options.history_size = MAX(atoi(optarg), 0);
+                options.history_set = true;
+                break;
+            case 'n':
+                options.repeat = MAX(atoi(optarg), 1);
+                break;
+            case 'b':
+                options.chunk = (size_t) MAX(atoi(optarg), 1);
+                break;
+            case 'c':
+                options.only = optarg;
+                break;
+            case 'k':
+                options.kernel = optarg;
+                break;
+            case 'R':
+#ifdef BENCH_RENDER
+                options.render = true;
+#else
+                fprintf(stderr, "Render mode is not built, use `make bench RENDER=1`\n");
+                return 1;
+#endif
+                break;
+            case 'z':
+                options.resizes = MAX(atoi(optarg), 1);
+                break;
+            case 's':
+                options.search = optarg;
+                break;
+            default:
+                bench_help();
+                return 1;
+        }
+    }
+
+    term_scan_init();
+    if (options.kernel && !term_scan_select(options.kernel)) {
+        fprintf(stderr, "Scan kernel %s is unknown or not supported by CPU\n", options.kernel);
+        return 1;
+    }
+    if (options.resizes) {
+        bench_buffer_t corpus = {};
+        bool ok = optind < argc ? bench_read_file(&corpus, argv[optind]) : (bench_corpus_plain(&corpus, &options), true);
+        printf("resize: %dx%d <-> %dx%d\n", options.width, options.height, MAX(options.width * 2 / 3, 1),
+               MAX(options.height - options.height / 4, 1));
+        printf("%-12s %10s %10s %10s %10s\n", "history KiB", "lines", "resizes", "us/resize", "rss KiB");
+        const int histories[] = BENCH_HISTORIES;
+        size_t count = options.history_set ? 1 : sizeof(histories) / sizeof(histories[0]);
+        for (size_t i = 0; i < count && ok; i++)
+            ok = bench_resize(&corpus, &options, options.history_set ? options.history_size : histories[i]);
+        free(corpus.data);
+        return ok ? 0 : 1;
+    }
+    if (options.search) {
+        bench_buffer_t corpus = {};
+        bool ok = optind < argc ? bench_read_file(&corpus, argv[optind]) : (bench_corpus_plain(&corpus, &options), true);
+        printf("search: \"%s\", screen: %dx%d\n", options.search, options.width, options.height);
+        printf("%-12s %10s %10s %10s %10s %10s\n", "history KiB", "lines", "matches", "type ms", "ns/line", "rss KiB");
+        const int histories[] = BENCH_HISTORIES;
+        size_t count = options.history_set ? 1 : sizeof(histories) / sizeof(histories[0]);
+        for (size_t i = 0; i < count && ok; i++)
+            ok = bench_search(&corpus, &options, options.history_set ? options.history_size : histories[i]);
+        free(corpus.data);
+        return ok ? 0 : 1;
+    }
+    printf("kernel: %s, screen: %dx%d, chunk: %zu bytes\n", term_scan_name(), options.width, options.height, options.chunk);
+    printf("%-12s %10s %10s %10s %10s", "corpus", "MiB", "MiB/s", "ns/byte", "scrolls");
+    if (options.render)
+        printf(" %8s %10s", "frames", "req/frame");
+    printf(" %10s\n", "rss KiB");
+
+    bool ok = true;
+    if (optind < argc) {
+        for (int i = optind; i < argc && ok; i++) {
+            bench_buffer_t corpus = {};
+            ok = bench_read_file(&corpus, argv[i]) && bench_run(argv[i], &corpus, &options);
+            free(corpus.data);
+        }
+        return ok ? 0 : 1;
+    }
+
+    for (size_t i = 0; i < sizeof(bench_corpora) / sizeof(bench_corpora[0]) && ok; i++) {
+        if (options.only && strcmp(options.only, bench_corpora[i].name))
+            continue;
+        bench_buffer_t corpus = {};
+        bench_corpora[i].generate(&corpus, &options);
+        ok = bench_run(bench_corpora[i].name, &corpus, &options);
+        free(corpus.data);
+    }
+    return ok ? 0 : 1;
+}
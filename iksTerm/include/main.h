@@ -25,6 +25,10 @@
  * @brief Defines the default font.
  */
 #define DEFAULT_FONT "fixed"
+/**
+ * @brief Defines the ISO 10646 encoding of default font, it's tried first when font is not set.
+ */
+#define DEFAULT_FONT_UNICODE "-misc-fixed-medium-r-semicondensed--13-120-75-75-c-60-iso10646-1"
 /**
  * @brief Defines the default terminal name.
  */
@@ -41,14 +45,62 @@
  * @brief Defines the default size of buffer.
  */
 #define READ_BUFFER_SIZE 4096
+/**
+ * @brief Defines the maximum size the read buffer grows to while draining PTY.
+ */
+#define READ_BUFFER_MAX (1024 * 1024)
+/**
+ * @brief Defines the default maximum frames per second.
+ */
+#define DEFAULT_FRAME_RATE 60
+/**
+ * @brief Defines the capacity of input queue that is kept after it's written, bigger one left by paste is freed.
+ */
+#define WRITE_BUFFER_KEEP (64 * 1024)
+/**
+ * @brief Defines the number of bytes of selection read by one request to X server while pasting.
+ */
+#define PASTE_CHUNK (64 * 1024)
+/**
+ * @brief Defines the maximum number of cells in search query.
+ */
+#define SEARCH_MAX 256
+/**
+ * @brief Defines the time in milliseconds between clicks of double and triple click.
+ */
+#define DOUBLE_CLICK_TIME 300
+/**
+ * @brief Defines the characters that end word selected by double click.
+ */
+#define SELECT_DELIMITERS " \t\"'`()[]{}<>|;,"
+/**
+ * @brief Defines the default cursor blink half-period in milliseconds.
+ */
+#define DEFAULT_BLINK_RATE 500
+/**
+ * @brief Defines the time in microseconds without input and output after which cursor stops blinking.
+ */
+#define BLINK_IDLE_TIMEOUT (10 * 1000000UL)
+/**
+ * @brief Defines the maximum number of wrapped history rows taken back to the screen when it's reflowed.
+ */
+#define REFLOW_HISTORY_ROWS 1024
+/**
+ * @brief Defines the time in microseconds window size must stay the same before screens are resized.
+ */
+#define RESIZE_DELAY 50000UL
+/**
+ * @brief Defines the maximum number of sessions (tabs) in one window.
+ */
+#define SESSION_MAX 16
 /**
  * @brief Defines the default tab size.
  */
 #define TAB_SIZE 4
 /**
- * @brief Defines the default history size.
+ * @brief Defines the default history size in KiB.
  */
-#define HISTORY_SIZE 10
+#define HISTORY_SIZE 4096
 
 // Basic ASCII printable range (space to tilde)
 #define IS_PRINTABLE_ASCII(c) ((c) >= 0x20 && (c) <= 0x7E)
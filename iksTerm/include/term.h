@@ -13,38 +13,63 @@ typedef struct term_t {
     int fd;             ///< File descriptor of terminal
     GC graphics_context;///< Graphics context
     Atom wm_delete;     ///< Atom for deleting
+    Atom atom_clipboard;///< CLIPBOARD selection
+    Atom atom_utf8;     ///< UTF8_STRING target of selection
+    Atom atom_incr;     ///< INCR type of selection sent in parts
+    Atom atom_paste;    ///< Property of window selection is pasted through
+    Atom atom_targets;  ///< TARGETS request for formats selection can be converted to
     XSizeHints hints;   ///< Hint to custom resizing
+    Pixmap back_buffer; ///< Frame is drawn here and then copied to window
 
     // Color
     char *hex_color_fg;                                ///< Name of fg color
     char *hex_color_bg;                                ///< Name of bg color
     char *hex_color_cursor;                            ///< Name of cursor color
     unsigned long int color_fg, color_bg, color_cursor;///< Number of allocated colors
+    term_palette_t palette;                            ///< RGB of indexed and truecolor colors
+    unsigned long pixels[COLOR_COUNT];                 ///< Cache of allocated pixels for color indices
+    bool pixel_ready[COLOR_COUNT];                     ///< Pixel of color index is allocated
+    unsigned long gc_fg, gc_bg;                        ///< Colors currently set in graphics context
 
     // Font
     char *font_name;            ///< Font name
     XFontStruct *font;          ///< Font structure
     int font_width, font_height;///< Font maximum sizes
+    uint16_t *glyph_cache;      ///< Glyph drawn for each BMP codepoint, 0 if not resolved yet
 
-    // Buffer
-    char *buffer;                        ///< Pointer to window buffer
-    int buffer_x, buffer_y;              ///< Cursor position (x,y)
-    int buffer_prompt_x, buffer_prompt_y;///< Prompt begin position
-
-    int buffer_width, buffer_height;///< Size of window in cols and rows
+    // Screen
+    screen_t *model;                ///< Model of rendered screen
+    int option_width, option_height;///< Size in cells requested by options, 0 for default
+    int history_size;               ///< History budget in KiB
     int width, height;              ///< Size of window in pixels
+
+    // Rendering
+    int cursor_drawn_x, cursor_drawn_y;///< Cursor position on the last drawn frame
+    bool cursor_blink_off;             ///< Cursor is in the hidden phase of blinking
+    char *draw_line;                   ///< Scratch row to build text runs
+    XChar2b *draw_line16;              ///< Scratch row to build runs of non-ASCII text
+    uint32_t *view_chars;              ///< Scratch row for history line characters
+    term_attr_t *view_attrs;           ///< Scratch row for history line attributes
+    int scratch_width;                 ///< Capacity of scratch rows in cells
+
+    // Frame pacing
+    int frame_rate;              ///< Maximum frames per second, 0 means draw after every read
+    unsigned long frame_interval;///< Minimal time between frames in microseconds
+    int blink_rate;              ///< Cursor blink half-period in milliseconds, 0 disables blinking
+
+    // Statistics
+    bool print_stats;            ///< Print statistics at exit and on SIGUSR1, collect latency histograms
+    unsigned long stats_frames;  ///< Number of drawn frames
+    unsigned long stats_requests;///< Number of X requests issued by drawing
+    term_stats_t stats;          ///< Latency histograms, filled only with `print_stats`
 } term_t;
 
 bool term_init(term_t *term);
 void term_draw(term_t *term);
-void term_scroll_buffer(term_t *term);
-void term_output(term_t *term, char *buf, ssize_t n);
+void term_present(term_t *term, int x, int y, int width, int height);
+void term_set_back_buffer(term_t *term);
 void term_set_color(term_t *term);
-void term_set_font(term_t *term);
+bool term_set_font(term_t *term);
 bool term_set_buffer(term_t *term);
-bool term_move_buffer(term_t *term, int new_buffer_width, int new_buffer_height);
-ssize_t term_parse_esc(term_t *term, char *buf);
-void handle_cursor_home(term_t *term);
-void handle_clear_screen(term_t *term);
 
 #endif
\ No newline at end of file
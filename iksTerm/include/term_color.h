@@ -0,0 +1,65 @@
+#ifndef TERM_COLOR_H
+#define TERM_COLOR_H
+
+/**
+ * @brief Defines the number of indexed colors (16 ANSI, 6x6x6 cube, 24 grays).
+ */
+#define COLOR_PALETTE_SIZE 256
+/**
+ * @brief Defines the color index of default foreground.
+ */
+#define COLOR_DEFAULT_FG 256
+/**
+ * @brief Defines the color index of default background.
+ */
+#define COLOR_DEFAULT_BG 257
+/**
+ * @brief Defines the first color index given to truecolor values.
+ */
+#define COLOR_TRUECOLOR_FIRST 258
+/**
+ * @brief Defines the number of color indices, it fits into 12 bits of attribute.
+ */
+#define COLOR_COUNT 4096
+/**
+ * @brief Defines the size of truecolor lookup hash table, power of two.
+ */
+#define COLOR_LOOKUP_SIZE 8192
+
+/**
+ * @brief Packed cell attributes: foreground index (bits 0-11), background index (bits 12-23), flags (bits 24-31).
+ */
+typedef uint32_t term_attr_t;
+
+#define ATTR_COLOR_MASK 0xFFFu
+#define ATTR_BG_SHIFT 12
+#define ATTR_FG(attr) ((int) ((attr) & ATTR_COLOR_MASK))
+#define ATTR_BG(attr) ((int) (((attr) >> ATTR_BG_SHIFT) & ATTR_COLOR_MASK))
+#define ATTR_SET_FG(attr, color) (((attr) & ~ATTR_COLOR_MASK) | (term_attr_t) (color))
+#define ATTR_SET_BG(attr, color) (((attr) & ~(ATTR_COLOR_MASK << ATTR_BG_SHIFT)) | ((term_attr_t) (color) << ATTR_BG_SHIFT))
+
+#define ATTR_BOLD (1u << 24)
+#define ATTR_UNDERLINE (1u << 25)
+#define ATTR_REVERSE (1u << 26)
+#define ATTR_ITALIC (1u << 27)
+#define ATTR_INVISIBLE (1u << 28)
+
+/**
+ * @brief Attributes of blank cell and of reset pen.
+ */
+#define ATTR_DEFAULT ((term_attr_t) COLOR_DEFAULT_FG | ((term_attr_t) COLOR_DEFAULT_BG << ATTR_BG_SHIFT))
+
+/*!
+ * @struct term_palette_t
+ * @brief Map color indices used in attributes to RGB, truecolor values get indices on first use
+ */
+typedef struct term_palette_t {
+    uint32_t rgb[COLOR_COUNT];         ///< 0xRRGGBB of every index
+    int truecolor_count;               ///< Number of indices given to truecolor values
+    uint16_t lookup[COLOR_LOOKUP_SIZE];///< Hash of RGB to index, 0 is empty slot
+} term_palette_t;
+
+void palette_init(term_palette_t *palette);
+int palette_truecolor(term_palette_t *palette, int red, int green, int blue);
+
+#endif
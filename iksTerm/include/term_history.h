@@ -0,0 +1,46 @@
+#ifndef TERM_HISTORY_H
+#define TERM_HISTORY_H
+
+/**
+ * @brief Defines the size of history arena chunk in bytes.
+ */
+#define HISTORY_CHUNK_SIZE (64 * 1024)
+
+/*!
+ * @struct history_chunk_t
+ * @brief Block of arena that stores lines one after another as [header][attribute runs][characters]
+ */
+typedef struct history_chunk_t {
+    struct history_chunk_t *next;///< Next (newer) chunk
+    size_t used;                 ///< Used bytes of data
+    size_t lines;                ///< Number of lines started in chunk
+    char data[];                 ///< Lines storage
+} history_chunk_t;
+
+/*!
+ * @struct term_history_t
+ * @brief Scrollback: lines scrolled off the screen, memory is bounded by the byte budget
+ *  Lines live in a FIFO of chunks, when budget is exceeded the oldest chunk with all its lines is evicted
+ *  and reused for new lines, so append and evict are O(1).
+ */
+typedef struct term_history_t {
+    history_chunk_t *oldest, *newest;///< FIFO of chunks
+    size_t chunk_count, chunk_limit; ///< Number of allocated chunks and the budget in chunks
+
+    char **lines;        ///< Ring of pointers to lines in chunks
+    size_t line_capacity;///< Capacity of lines ring
+    size_t line_head;    ///< Index of the oldest line in ring
+    size_t line_count;   ///< Number of stored lines
+    size_t line_total;   ///< Lines pushed and not popped so far, it's the absolute number of the next line
+} term_history_t;
+
+bool history_init(term_history_t *history, size_t budget);
+bool history_push(term_history_t *history, const uint32_t *chars, const term_attr_t *attrs, int length, bool wrapped);
+bool history_get(term_history_t *history, size_t age, uint32_t *chars, term_attr_t *attrs, int width);
+int history_line(term_history_t *history, size_t age, bool *wrapped);
+const char *history_text(term_history_t *history, size_t age, int *length, int *char_size);
+void history_pop(term_history_t *history);
+void history_clear(term_history_t *history);
+void history_destroy(term_history_t *history);
+
+#endif
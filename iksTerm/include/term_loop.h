@@ -0,0 +1,54 @@
+#ifndef TERM_LOOP_H
+#define TERM_LOOP_H
+
+/**
+ * @brief Defines the maximum number of fds registered in event loop.
+ */
+#define LOOP_MAX_SOURCES 32
+/**
+ * @brief Defines the maximum number of events taken by one `epoll_wait`.
+ */
+#define LOOP_MAX_EVENTS 16
+
+struct term_loop_t;
+
+/*!
+ * \brief Handler of fd activity, `events` are epoll flags, EPOLLIN for deferred call
+ */
+typedef void (*loop_handler_t)(struct term_loop_t *loop, void *data, uint32_t events);
+
+/*!
+ * @struct loop_source_t
+ * @brief Fd registered in event loop with its handler
+ */
+typedef struct loop_source_t {
+    int fd;                ///< Watched fd, -1 for free slot
+    loop_handler_t handler;///< Called when fd is ready
+    uint32_t events;       ///< Epoll flags fd is watched for
+    void *data;            ///< Passed to handler
+    bool deferred;         ///< Handler has more work, it's called again without waiting
+} loop_source_t;
+
+/*!
+ * @struct term_loop_t
+ * @brief Event loop on epoll, fds are registered once and dispatched to handlers
+ */
+typedef struct term_loop_t {
+    int fd_epoll;                           ///< Epoll instance
+    loop_source_t sources[LOOP_MAX_SOURCES];///< Slots of sources, pointers to them are stable
+    int deferred_count;                     ///< Number of deferred sources
+    bool running;                           ///< Loop runs until handler clears it
+} term_loop_t;
+
+bool loop_init(term_loop_t *loop);
+loop_source_t *loop_add(term_loop_t *loop, int fd, uint32_t events, loop_handler_t handler, void *data);
+bool loop_modify(term_loop_t *loop, loop_source_t *source, uint32_t events);
+void loop_remove(term_loop_t *loop, loop_source_t *source);
+void loop_defer(term_loop_t *loop, loop_source_t *source);
+bool loop_run(term_loop_t *loop);
+void loop_destroy(term_loop_t *loop);
+int loop_timer_new();
+bool loop_timer_set(int fd, unsigned long delay_us, unsigned long interval_us);
+uint64_t loop_timer_ack(int fd);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef TERM_PARSER_H
+#define TERM_PARSER_H
+
+/**
+ * @brief Defines the maximum number of CSI parameters.
+ */
+#define PARSER_MAX_PARAMS 16
+/**
+ * @brief Defines the maximum number of intermediate characters.
+ */
+#define PARSER_MAX_INTERMEDIATES 2
+/**
+ * @brief Defines the maximum length of OSC string.
+ */
+#define PARSER_MAX_OSC 256
+
+/*!
+ * @enum parser_state_t
+ * @brief States of DEC/ECMA-48 parser (Paul Williams' state machine)
+ */
+typedef enum parser_state_t {
+    STATE_GROUND = 0,
+    STATE_ESCAPE,
+    STATE_ESCAPE_INTERMEDIATE,
+    STATE_CSI_ENTRY,
+    STATE_CSI_PARAM,
+    STATE_CSI_INTERMEDIATE,
+    STATE_CSI_IGNORE,
+    STATE_DCS_ENTRY,
+    STATE_DCS_PARAM,
+    STATE_DCS_INTERMEDIATE,
+    STATE_DCS_PASSTHROUGH,
+    STATE_DCS_IGNORE,
+    STATE_OSC_STRING,
+    STATE_SOS_PM_APC_STRING,
+    STATE_COUNT,
+    STATE_KEEP = 0xFF,///< Table value to stay in current state without transition
+} parser_state_t;
+
+/*!
+ * @enum parser_action_t
+ * @brief Actions performed by parser on input byte
+ */
+typedef enum parser_action_t {
+    ACTION_IGNORE = 0,
+    ACTION_PRINT,
+    ACTION_EXECUTE,
+    ACTION_CLEAR,
+    ACTION_COLLECT,
+    ACTION_PARAM,
+    ACTION_ESC_DISPATCH,
+    ACTION_CSI_DISPATCH,
+    ACTION_OSC_START,
+    ACTION_OSC_PUT,
+    ACTION_OSC_END,
+} parser_action_t;
+
+/*!
+ * @struct term_parser_t
+ * @brief Keep state of escape sequence parser, it persists between reads from PTY
+ */
+typedef struct term_parser_t {
+    parser_state_t state;///< Current state
+
+    int params[PARSER_MAX_PARAMS];              ///< Numeric parameters, 0 if omitted
+    int param_count;                            ///< Number of started parameters
+    uint32_t subparams;                         ///< Bit i is set if parameter i follows ':' (sub-parameter)
+    char intermediates[PARSER_MAX_INTERMEDIATES];///< Intermediate and private marker characters
+    int intermediate_count;                     ///< Number of collected intermediates
+    bool overflow;                              ///< Too many params or intermediates, sequence is dropped
+
+    char osc[PARSER_MAX_OSC];///< OSC string
+    int osc_length;          ///< Length of OSC string
+
+    utf8_decoder_t utf8;///< Decoder of text, sequence split between reads is continued
+} term_parser_t;
+
+void term_parser_init();
+
+#endif
@@ -13,16 +13,47 @@ typedef struct pty_t {
     int fd_master;///< The master file descriptor.
     int fd_slave; ///< The slave file descriptor.
     pid_t pid;    ///< The PID of shell process.
+    // Read buffer
+    char *read_buffer;   ///< Growable buffer PTY is drained into.
+    size_t read_capacity;///< Capacity of read buffer.
+    bool read_more;      ///< Read stopped at buffer limit before PTY was drained.
+    // Input queue
+    char *write_buffer;   ///< Keys, paste and replies waiting until PTY accepts them.
+    size_t write_offset;  ///< Number of queued bytes already written.
+    size_t write_length;  ///< Number of queued bytes.
+    size_t write_capacity;///< Capacity of input queue.
+    // Reader thread
+    bool threaded;              ///< PTY is drained by reader thread into ring, UI thread only parses and draws.
+    pthread_t reader;           ///< Reader thread.
+    term_ring_t ring;           ///< Bytes read from PTY and not parsed yet.
+    int fd_ready;               ///< Eventfd signaled by reader when ring gets data or PTY is closed.
+    int fd_wake;                ///< Eventfd signaled by UI thread when ring gets space or reader must stop.
+    _Atomic bool reader_waiting;///< Reader waits for space in full ring.
+    _Atomic bool reader_stop;   ///< Reader must exit.
+    _Atomic bool reader_closed; ///< PTY is closed and reader exited.
+    // Recording
+    const char *record_path;///< Log output of the first session is recorded to, NULL for none.
+    term_record_t *record;  ///< Open log, NULL if this PTY isn't recorded.
+    const char *replay_path;///< Log replayed instead of running shell, NULL for none.
+    double replay_speed;    ///< Replay speed multiplier, 0 replays as fast as possible.
+    // Statistics
+    term_stats_t *stats;///< Latency histograms keys and reads are recorded to, NULL when disabled.
 } pty_t;
 
 bool pty_new(pty_t *pty);
-bool term_resize(term_t *term, pty_t *pty, XEvent *event);
-bool pty_resize(term_t *term, pty_t *pty);
+bool pty_start_reader(pty_t *pty);
+void pty_stop_reader(pty_t *pty);
+void pty_destroy(pty_t *pty);
+bool term_resize(term_t *term, XEvent *event);
+bool pty_resize(pty_t *pty, int width, int height);
+bool term_scroll_key(term_t *term, XKeyEvent *ev);
+bool pty_queue(pty_t *pty, const char *data, size_t n);
+bool pty_flush(pty_t *pty);
 void term_pty_write(pty_t *pty, XKeyEvent *ev);
-bool term_pty_read(term_t *term, pty_t *pty);
+bool term_pty_read(screen_t *screen, pty_t *pty);
 bool run(term_t *term, pty_t *pty);
 
-bool term_destroy(term_t *term, pty_t *pty);
-void term_catch_error(term_t *term, pty_t *pty);
+bool term_destroy(term_t *term);
+void term_catch_error(term_t *term);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef TERM_RECORD_H
+#define TERM_RECORD_H
+
+/**
+ * @brief Defines the magic bytes record log starts with, they are followed by screen width and height.
+ */
+#define RECORD_MAGIC "iksrec1\n"
+/**
+ * @brief Defines the length of record magic.
+ */
+#define RECORD_MAGIC_SIZE 8
+/**
+ * @brief Defines the size of ring records wait in until writer thread puts them into file.
+ */
+#define RECORD_RING_SIZE (4 * 1024 * 1024)
+/**
+ * @brief Defines the maximum size of LEB128 varint of 64 bits.
+ */
+#define RECORD_VARINT_MAX 10
+/**
+ * @brief Defines the time in microseconds producer sleeps while writer frees space in full ring.
+ */
+#define RECORD_FULL_SLEEP 100
+
+/*!
+ * @enum record_type_t
+ * @brief Type of record, it's stored in the low bit of the length field
+ */
+typedef enum record_type_t {
+    RECORD_OUTPUT = 0,///< Bytes written by shell
+    RECORD_RESIZE,    ///< New screen size in cells
+    RECORD_END,       ///< End of log or broken record, not stored
+} record_type_t;
+
+/*!
+ * @struct term_record_t
+ * @brief Append-only log of shell output
+ *  Each record is [varint time delta in us][varint length << 1 | type][payload]. UI thread only copies records
+ *  into ring, writer thread puts them into file, so disk never stalls parsing.
+ */
+typedef struct term_record_t {
+    int fd;                     ///< File of log
+    unsigned long time_last;    ///< Time of the previous record
+    term_ring_t ring;           ///< Records not written to file yet
+    pthread_t writer;           ///< Writer thread
+    int fd_wake;                ///< Eventfd signaled when ring gets data or writer must stop
+    _Atomic bool writer_waiting;///< Writer waits for data in empty ring
+    _Atomic bool writer_stop;   ///< Writer must drain ring and exit
+    bool writer_started;        ///< Writer thread is running
+} term_record_t;
+
+/*!
+ * @struct term_replay_t
+ * @brief Record log mapped into memory and read record by record
+ */
+typedef struct term_replay_t {
+    const char *data;           ///< Mapped log
+    size_t size;                ///< Size of log
+    size_t offset;              ///< Offset of the next record
+    int width, height;          ///< Screen size when recording started
+    unsigned long time;         ///< Recorded time of the last read record in us
+    const char *output;         ///< Bytes of the last output record
+    size_t output_length;       ///< Number of bytes of the last output record
+    int resize_width;           ///< Width of the last resize record
+    int resize_height;          ///< Height of the last resize record
+    size_t stats_bytes;         ///< Output bytes read so far
+    unsigned long stats_records;///< Records read so far
+} term_replay_t;
+
+bool record_open(term_record_t *record, const char *path, int width, int height);
+void record_output(term_record_t *record, const char *data, size_t n);
+void record_resize(term_record_t *record, int width, int height);
+void record_close(term_record_t *record);
+bool replay_open(term_replay_t *replay, const char *path);
+record_type_t replay_next(term_replay_t *replay);
+void replay_close(term_replay_t *replay);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef TERM_RING_H
+#define TERM_RING_H
+
+/**
+ * @brief Defines the size of cache line, indices of ring live on separate lines.
+ */
+#define RING_CACHE_LINE 64
+
+/*!
+ * @struct term_ring_t
+ * @brief Lock-free single-producer/single-consumer byte ring
+ *  Producer only stores `head` and consumer only stores `tail`, indices grow freely and are masked by capacity.
+ */
+typedef struct term_ring_t {
+    char *data;     ///< Storage of bytes
+    size_t capacity;///< Size of storage, power of two
+
+    _Alignas(RING_CACHE_LINE) _Atomic size_t head;///< Number of bytes ever written, stored by producer
+    _Alignas(RING_CACHE_LINE) _Atomic size_t tail;///< Number of bytes ever read, stored by consumer
+} term_ring_t;
+
+bool ring_init(term_ring_t *ring, size_t capacity);
+void ring_destroy(term_ring_t *ring);
+size_t ring_write_span(term_ring_t *ring, char **span);
+void ring_commit(term_ring_t *ring, size_t n);
+size_t ring_read_span(term_ring_t *ring, const char **span);
+void ring_consume(term_ring_t *ring, size_t n);
+bool ring_empty(term_ring_t *ring);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef TERM_SCAN_H
+#define TERM_SCAN_H
+
+/*!
+ * @brief Kernel returning length of printable ASCII run at the beginning of buffer
+ */
+typedef size_t (*scan_printable_t)(const unsigned char *buf, size_t n);
+
+extern scan_printable_t term_scan_printable;
+
+void term_scan_init();
+bool term_scan_select(const char *name);
+const char *term_scan_name();
+
+#endif
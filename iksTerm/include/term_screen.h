@@ -0,0 +1,141 @@
+#ifndef TERM_SCREEN_H
+#define TERM_SCREEN_H
+
+/*!
+ * @struct term_row_t
+ * @brief Row of cells stored as struct of arrays, so scans over characters or attributes stay dense
+ */
+typedef struct term_row_t {
+    uint32_t *chars;   ///< Codepoints of cells, 0 for never written cell
+    term_attr_t *attrs;///< Packed attributes and colors of cells
+    bool wrapped;      ///< Text continues on the next row (soft wrap), so reflow joins them
+} term_row_t;
+
+/*!
+ * @struct screen_grid_t
+ * @brief Storages and cursor of the screen that isn't shown, they are swapped with the live ones by pointers
+ */
+typedef struct screen_grid_t {
+    uint32_t *buffer;         ///< Storage of cell characters
+    term_attr_t *buffer_attrs;///< Storage of cell attributes
+    term_row_t *rows;         ///< Ring of rows pointing into storages
+    int row_head;             ///< Index in `rows` of the top row
+    size_t cell_capacity;     ///< Cells allocated in storages
+    int row_capacity;         ///< Rows allocated in `rows`
+    int width, height;        ///< Size rows are laid out for, hidden grid is laid out again when it differs
+    int cursor_x, cursor_y;   ///< Cursor position
+    bool wrap_pending;        ///< Cursor is past the last column
+} screen_grid_t;
+
+/*!
+ * @struct screen_cursor_t
+ * @brief Cursor saved by DECSC
+ */
+typedef struct screen_cursor_t {
+    int x, y;         ///< Position
+    bool wrap_pending;///< Next printable wraps
+    term_attr_t pen;  ///< Attributes of new characters
+    bool valid;       ///< Cursor was saved, DECRC without it homes cursor
+} screen_cursor_t;
+
+/*!
+ * @struct screen_t
+ * @brief Display-free model of terminal: grid, cursor, parser and history
+ *  Output of the shell changes only this struct, renderer reads it and clears damage.
+ */
+typedef struct screen_t {
+    // Grid
+    uint32_t *buffer;               ///< Storage of cell characters
+    term_attr_t *buffer_attrs;      ///< Storage of cell attributes
+    term_row_t *rows;               ///< Ring of rows pointing into storages
+    int row_head;                   ///< Index in `rows` of the top screen row
+    int buffer_width, buffer_height;///< Size of screen in cols and rows
+    size_t cell_capacity;           ///< Cells allocated in storages, shrinking reuses them
+    int row_capacity;               ///< Rows allocated in `rows`
+    int buffer_x, buffer_y;         ///< Cursor position (x,y)
+    bool wrap_pending;              ///< Cursor is past the last column, next printable wraps
+    bool cursor_hidden;             ///< Cursor is hidden by DECTCEM
+    bool bracketed_paste;           ///< Paste is wrapped in `ESC [200~` and `ESC [201~` (DECSET 2004)
+    term_attr_t pen;                ///< Attributes for new characters, set by SGR
+    term_palette_t *palette;        ///< Palette where truecolor values of SGR are stored
+    int scroll_top, scroll_bottom;  ///< Scroll region rows [top, bottom) set by DECSTBM
+
+    // Alternate screen
+    screen_grid_t grid_hidden;///< Grid that isn't shown: alternate one (allocated on first use), then primary one
+    bool alternate;           ///< Alternate screen is shown (DECSET 1049, 1047, 47)
+    screen_cursor_t saved[2]; ///< Cursors saved by DECSC on primary and alternate screens
+
+    // Parser
+    term_parser_t parser;      ///< Escape sequences parser state
+    char answer[64];           ///< Replies to the shell (status reports), written after parsing
+    int answer_length;         ///< Length of pending reply
+    char title[PARSER_MAX_OSC];///< Window title set by OSC
+    bool title_changed;        ///< Title must be stored to the window
+
+    // History
+    term_history_t history;///< Lines scrolled off the screen
+    size_t view_offset;    ///< Number of history lines the view is scrolled back
+    bool view_changed;     ///< View was scrolled since the last frame
+
+    // Selection and search
+    term_select_t select;///< Selected text, it's shown reversed
+    term_search_t search;///< Search over history and screen, current match is selected
+
+    // Damage
+    int *damage_begin, *damage_end;///< Dirty column span [begin, end) of each row, empty if begin >= end
+    int damage_capacity;           ///< Rows allocated in damage spans
+    bool damage_all;               ///< Whole window must be repainted (Expose, resize)
+    int scroll_pending;            ///< Rows scrolled since the last drawn frame
+
+    // Reflow scratch, kept between resizes
+    uint32_t *reflow_chars;   ///< Characters of logical lines
+    term_attr_t *reflow_attrs;///< Attributes of logical lines
+    size_t reflow_capacity;   ///< Capacity of scratch in cells
+    int *reflow_ends;         ///< End of each logical line in scratch
+    int reflow_lines;         ///< Capacity of `reflow_ends`
+
+    // Statistics
+    unsigned long stats_scrolls;///< Number of lines scrolled off the screen
+} screen_t;
+
+/*!
+ * \brief Get row y of the screen from the rows ring
+ */
+static inline term_row_t *screen_row(screen_t *screen, int y) {
+    int index = screen->row_head + y;
+    if (index >= screen->buffer_height)
+        index -= screen->buffer_height;
+    return &screen->rows[index];
+}
+
+bool screen_init(screen_t *screen, term_palette_t *palette, int width, int height, size_t history_budget);
+void screen_destroy(screen_t *screen);
+bool screen_resize(screen_t *screen, int new_buffer_width, int new_buffer_height);
+void screen_output(screen_t *screen, const char *buf, size_t n);
+void screen_damage(screen_t *screen, int y, int x_begin, int x_end);
+void screen_damage_rows(screen_t *screen, int y_begin, int y_end);
+void screen_damage_all(screen_t *screen);
+void screen_scroll_up(screen_t *screen);
+void screen_scroll_down(screen_t *screen);
+void screen_scroll_view(screen_t *screen, int count);
+void screen_line_feed(screen_t *screen);
+void screen_put_run(screen_t *screen, const char *text, size_t len);
+void screen_put_char(screen_t *screen, uint32_t c);
+void screen_cursor_to(screen_t *screen, int x, int y);
+void screen_clear_cells(term_row_t *row, int x_begin, int x_end, term_attr_t attr);
+void screen_erase(screen_t *screen, int y, int x_begin, int x_end);
+void screen_insert_blanks(screen_t *screen, int count);
+void screen_delete_chars(screen_t *screen, int count);
+void screen_answer(screen_t *screen, const char *answer, int length);
+void screen_cursor_home(screen_t *screen);
+void screen_clear(screen_t *screen);
+void screen_rotate_rows(screen_t *screen, int top, int bottom, int count);
+void screen_insert_lines(screen_t *screen, int count);
+void screen_delete_lines(screen_t *screen, int count);
+void screen_set_region(screen_t *screen, int top, int bottom);
+void screen_reverse_line_feed(screen_t *screen);
+void screen_save_cursor(screen_t *screen);
+void screen_restore_cursor(screen_t *screen);
+void screen_set_alternate(screen_t *screen, bool enable);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef TERM_SELECT_H
+#define TERM_SELECT_H
+
+struct screen_t;
+
+/*!
+ * @enum select_mode_t
+ * @brief Unit selection grows by
+ */
+typedef enum select_mode_t {
+    SELECT_CHAR = 0,///< Cells, set by click and drag
+    SELECT_WORD,    ///< Words, set by double click
+    SELECT_LINE,    ///< Whole lines, set by triple click
+} select_mode_t;
+
+/*!
+ * @struct select_point_t
+ * @brief Cell addressed by absolute line number, so it stays on the same text while lines scroll into history
+ *  History line pushed first is line 0, screen row y is line `history.line_total + y`.
+ */
+typedef struct select_point_t {
+    size_t line;///< Absolute line number
+    int x;      ///< Column
+} select_point_t;
+
+/*!
+ * @struct term_select_t
+ * @brief Selection of screen and history text
+ */
+typedef struct term_select_t {
+    select_point_t anchor, head;///< Cell selection started at and cell it's extended to
+    select_point_t begin, end;  ///< Selected cells [begin, end] in text order, expanded to words or lines
+    select_mode_t mode;         ///< Unit of selection
+    bool active;                ///< Something is selected
+    uint32_t *chars;            ///< Scratch row history lines are expanded into
+    term_attr_t *attrs;         ///< Scratch row of attributes
+    int scratch_width;          ///< Capacity of scratch rows in cells
+} term_select_t;
+
+/*!
+ * @struct term_search_t
+ * @brief Search of text over history and screen
+ *  Matches in history are kept in text order and only lines pushed since the last update are scanned, so search
+ *  stays interactive with long scrollback. Screen rows change all the time, they are scanned when needed.
+ */
+typedef struct term_search_t {
+    uint32_t query[SEARCH_MAX];     ///< Searched cells, double-width character is followed by its tail cell
+    int length;                     ///< Number of query cells
+    char query_latin1[SEARCH_MAX];  ///< Query as bytes of history lines stored with one byte per character
+    bool latin1;                    ///< All query characters fit in one byte, otherwise such lines can't match
+    select_point_t *matches;        ///< Matches in history in text order, [match_first, match_count) are valid
+    size_t match_first, match_count;///< Range of valid matches, evicted ones are skipped by moving the first
+    size_t match_capacity;          ///< Allocated matches
+    size_t scanned;                 ///< Absolute number of the first history line not scanned yet
+    select_point_t current;         ///< Match shown last
+    bool found;                     ///< `current` is set
+    bool active;                    ///< Keys edit query instead of going to shell
+} term_search_t;
+
+void select_start(struct screen_t *screen, int x, int y, select_mode_t mode);
+void select_extend(struct screen_t *screen, int x, int y);
+void select_set(struct screen_t *screen, select_point_t begin, select_point_t end);
+void select_clear(struct screen_t *screen);
+bool select_span(struct screen_t *screen, int y, int *x_begin, int *x_end);
+char *select_text(struct screen_t *screen, size_t *length);
+void select_destroy(term_select_t *select);
+bool search_type(struct screen_t *screen, uint32_t c);
+void search_backspace(struct screen_t *screen);
+void search_update(struct screen_t *screen);
+void search_rewind(struct screen_t *screen, size_t line);
+bool search_next(struct screen_t *screen, bool older);
+size_t search_count(struct screen_t *screen);
+void search_destroy(term_search_t *search);
+
+#endif
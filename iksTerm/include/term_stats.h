@@ -0,0 +1,51 @@
+#ifndef TERM_STATS_H
+#define TERM_STATS_H
+
+/**
+ * @brief Defines the number of bits of sub-buckets in each power of two, histogram keeps values within 1/16.
+ */
+#define STATS_SUB_BITS 4
+/**
+ * @brief Defines the number of histogram buckets, they cover all 64-bit values.
+ */
+#define STATS_BUCKETS ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+/*!
+ * @struct stats_histogram_t
+ * @brief Log-linear (HDR-style) histogram, recording is one increment and its memory doesn't grow
+ *  Values below 16 have own buckets, above them each power of two is split into 16 buckets.
+ */
+typedef struct stats_histogram_t {
+    const char *name;              ///< Name in report
+    double scale;                  ///< Factor values are printed with (1e-3 shows ns as us)
+    uint64_t counts[STATS_BUCKETS];///< Number of values in each bucket
+    uint64_t count;                ///< Number of recorded values
+    uint64_t min, max;             ///< Exact extremes
+    double sum;                    ///< Sum of values for mean
+} stats_histogram_t;
+
+/*!
+ * @struct term_stats_t
+ * @brief Latency and throughput histograms collected with `--stats`
+ *  Echo latency is measured from the first key written to PTY until the first frame drawn after that PTY answered.
+ */
+typedef struct term_stats_t {
+    stats_histogram_t latency;   ///< Keypress to frame with echo in ns
+    stats_histogram_t read_bytes;///< Bytes parsed per read of PTY
+    stats_histogram_t parse;     ///< Parse time of one read in ns
+    stats_histogram_t draw;      ///< Draw time of one frame in ns
+    uint64_t key_time;           ///< Time of the first key not echoed yet, 0 for none
+    const void *key_target;      ///< PTY key is written to, its output is the echo
+    bool key_echoed;             ///< Key target has answered, the next frame shows the echo
+} term_stats_t;
+
+void stats_init(term_stats_t *stats);
+uint64_t stats_now();
+void stats_record(stats_histogram_t *histogram, uint64_t value);
+uint64_t stats_percentile(const stats_histogram_t *histogram, double percentile);
+void stats_key(term_stats_t *stats, const void *target);
+void stats_output(term_stats_t *stats, const void *source, size_t bytes, uint64_t elapsed);
+void stats_frame(term_stats_t *stats, uint64_t elapsed);
+void stats_print(const term_stats_t *stats, FILE *file);
+
+#endif
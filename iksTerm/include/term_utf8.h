@@ -0,0 +1,78 @@
+#ifndef TERM_UTF8_H
+#define TERM_UTF8_H
+
+/**
+ * @brief Defines the codepoint shown instead of malformed input.
+ */
+#define UTF8_REPLACEMENT 0xFFFD
+/**
+ * @brief Defines the cell value of the right half of double-width character.
+ */
+#define CELL_WIDE_TAIL 0xFFFFFFFFu
+
+/*!
+ * @enum utf8_result_t
+ * @brief Result of feeding byte to decoder
+ */
+typedef enum utf8_result_t {
+    UTF8_INCOMPLETE = 0,///< Byte is consumed, codepoint is not complete yet
+    UTF8_DONE,          ///< Byte is consumed and codepoint is ready
+    UTF8_RETRY,         ///< Sequence was broken: replacement is ready, byte must be fed again
+} utf8_result_t;
+
+/*!
+ * @struct utf8_decoder_t
+ * @brief Incremental UTF-8 decoder, state persists between reads from PTY
+ */
+typedef struct utf8_decoder_t {
+    uint32_t codepoint;///< Bits collected so far
+    uint32_t min;      ///< Smallest codepoint allowed for sequence length, smaller ones are overlong
+    int remaining;     ///< Number of continuation bytes still expected
+} utf8_decoder_t;
+
+/*!
+ * \brief Feed byte to decoder
+ */
+static inline utf8_result_t utf8_decode(utf8_decoder_t *decoder, unsigned char c, uint32_t *codepoint) {
+    if (decoder->remaining) {
+        if ((c & 0xC0) != 0x80) {
+            decoder->remaining = 0;
+            *codepoint = UTF8_REPLACEMENT;
+            return UTF8_RETRY;
+        }
+        decoder->codepoint = (decoder->codepoint << 6) | (c & 0x3F);
+        if (--decoder->remaining)
+            return UTF8_INCOMPLETE;
+        uint32_t value = decoder->codepoint;
+        if (value < decoder->min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+            value = UTF8_REPLACEMENT;
+        *codepoint = value;
+        return UTF8_DONE;
+    }
+    if (c < 0x80) {
+        *codepoint = c;
+        return UTF8_DONE;
+    }
+    if ((c & 0xE0) == 0xC0) {
+        decoder->codepoint = c & 0x1F;
+        decoder->min = 0x80;
+        decoder->remaining = 1;
+    } else if ((c & 0xF0) == 0xE0) {
+        decoder->codepoint = c & 0x0F;
+        decoder->min = 0x800;
+        decoder->remaining = 2;
+    } else if ((c & 0xF8) == 0xF0) {
+        decoder->codepoint = c & 0x07;
+        decoder->min = 0x10000;
+        decoder->remaining = 3;
+    } else {
+        *codepoint = UTF8_REPLACEMENT;
+        return UTF8_DONE;
+    }
+    return UTF8_INCOMPLETE;
+}
+
+int utf8_width(uint32_t c);
+int utf8_encode(uint32_t c, char *out);
+
+#endif
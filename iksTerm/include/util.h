@@ -5,5 +5,6 @@ void get_options(term_t *term, pty_t *pty, int argc, char **argv);
 void print_help();
 
 bool is_valid_hex_color(const char *str);
+unsigned long time_now_us();
 
 #endif
\ No newline at end of file
@@ -1,14 +1,28 @@
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#include "main.h"
+#include "term_color.h"
+#include "term_history.h"
+#include "term_utf8.h"
+#include "term_parser.h"
+#include "term_select.h"
+#include "term_screen.h"
+#include "term_ring.h"
+#include "term_record.h"
+#include "term_stats.h"
 #include "term.h"
 #include "term_pty.h"
 #include "util.h"
 
 int main(int argc, char **argv) {
-    term_t term = {};
+    screen_t screen = {};
+    term_t term = {.model = &screen};
     pty_t pty = {};
 
     // Get command line options
@@ -17,16 +31,11 @@ int main(int argc, char **argv) {
     // Init X11 window
     if (!term_init(&term))
         return 1;
-    // Create PTY
-    if (!pty_new(&pty))
-        return 1;
-    if (!pty_resize(&term, &pty))
-        return 1;
-    // Process channel between X-Server and shell
+    // Process channels between X-Server and shells, the first one is created on `screen` with `pty`
     if (!run(&term, &pty))
         return 1;
     // Destroy X11 window
-    if (!term_destroy(&term, &pty))
+    if (!term_destroy(&term))
         return 1;
     return 0;
 }
@@ -1,4 +1,6 @@
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,12 +12,19 @@
 #include <X11/Xutil.h>
 
 #include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+#include <term_utf8.h>
+#include <term_parser.h>
+#include <term_select.h>
+#include <term_screen.h>
+#include <term_ring.h>
+#include <term_record.h>
+#include <term_stats.h>
 #include <term.h>
 #include <term_pty.h>
 #include <util.h>
 
-static bool just_wrapped = false;// flag to avoid double moving next line
-
 /*!
  * \brief Initialize and setup X11 window for terminal
  */
@@ -33,20 +42,23 @@ bool term_init(term_t *term) {
     XSetWindowAttributes winattr = {
         .background_pixmap = ParentRelative,
         .event_mask = FocusChangeMask | KeyPressMask | KeyReleaseMask | ExposureMask | VisibilityChangeMask |
-                      StructureNotifyMask | ButtonMotionMask | ButtonPressMask | ButtonReleaseMask | ClientMessage,
+                      StructureNotifyMask | ButtonMotionMask | ButtonPressMask | ButtonReleaseMask | PropertyChangeMask |
+                      ClientMessage,
     };
     // Set colors
     term_set_color(term);
     // Load font
-    term_set_font(term);
+    if (!term_set_font(term))
+        return false;
     // Load buffer
     if (!term_set_buffer(term))
         return false;
-    // Init history
+    // Frame pacing
+    term->frame_interval = (term->frame_rate > 0) ? 1000000UL / (unsigned long) term->frame_rate : 0;
 
     // Get sizes in pixels
-    term->width = term->buffer_width * term->font_width;
-    term->height = term->buffer_height * term->font_height;
+    term->width = term->model->buffer_width * term->font_width;
+    term->height = term->model->buffer_height * term->font_height;
     // Create window
     term->window = XCreateWindow(term->display,
                                  term->root,
@@ -63,6 +75,12 @@ bool term_init(term_t *term) {
     // Enable WM_DELETE_WINDOW protocol
     term->wm_delete = XInternAtom(term->display, "WM_DELETE_WINDOW", False);
     XSetWMProtocols(term->display, term->window, &term->wm_delete, 1);
+    // Atoms of paste and copy
+    term->atom_clipboard = XInternAtom(term->display, "CLIPBOARD", False);
+    term->atom_utf8 = XInternAtom(term->display, "UTF8_STRING", False);
+    term->atom_incr = XInternAtom(term->display, "INCR", False);
+    term->atom_paste = XInternAtom(term->display, TERM_NAME "_PASTE", False);
+    term->atom_targets = XInternAtom(term->display, "TARGETS", False);
     // Set resizing with hint
     term->hints.flags = PBaseSize | PResizeInc;
     term->hints.base_width = term->font_width;  // Базовая ширина окна
@@ -74,6 +92,13 @@ bool term_init(term_t *term) {
     XStoreName(term->display, term->window, TERM_NAME);
     XMapWindow(term->display, term->window);
     term->graphics_context = XCreateGC(term->display, term->window, 0, NULL);
+    term->gc_fg = term->color_fg;
+    term->gc_bg = term->color_bg;
+    XSetForeground(term->display, term->graphics_context, term->gc_fg);
+    XSetBackground(term->display, term->graphics_context, term->gc_bg);
+    // Copies are made from back buffer which is never obscured, so exposure events aren't needed
+    XSetGraphicsExposures(term->display, term->graphics_context, False);
+    term_set_back_buffer(term);
 
     XFlush(term->display);
 
@@ -81,229 +106,343 @@ bool term_init(term_t *term) {
 }
 
 /*!
- * \brief Realloc and move buffer while resizing
+ * \brief Get row y of the view, it's expanded from history when view is scrolled back
  */
-bool term_move_buffer(term_t *term, int new_buffer_width, int new_buffer_height) {
-    char *new_buffer = calloc((long unsigned int) new_buffer_width * (long unsigned int) new_buffer_height, sizeof(char));
-    if (!new_buffer) {
-        perror("calloc");
-        return false;
+static term_row_t term_view_row(term_t *term, int y) {
+    screen_t *screen = term->model;
+    if (y < (int) screen->view_offset) {
+        term_row_t row = {.chars = term->view_chars, .attrs = term->view_attrs};
+        history_get(&screen->history, screen->view_offset - 1 - (size_t) y, row.chars, row.attrs, screen->buffer_width);
+        return row;
     }
-    int last_non_empty = 0;
-    for (int i = 0; i < term->buffer_height; i++) {
-        bool row_has_content = false;
-        for (int j = 0; j < term->buffer_width; j++) {
-            if (term->buffer[i * term->buffer_width + j] != '\0') {
-                row_has_content = true;
-                break;
-            }
-        }
-        if (row_has_content) {
-            last_non_empty = i;
-        }
-    }
-    int effective_rows = last_non_empty + 1;
-    int start_row = 0;
-    if (new_buffer_height <= term->buffer_height)
-        start_row = (effective_rows > new_buffer_height) ? (effective_rows - new_buffer_height) : 0;
-
-    int rows_to_copy = MIN(new_buffer_height, term->buffer_height - start_row);
-    int min_width = MIN(new_buffer_width, term->buffer_width);
+    return *screen_row(screen, y - (int) screen->view_offset);
+}
 
-    for (int i = 0; i < rows_to_copy; i++) {
-        memcpy(new_buffer + i * new_buffer_width,
-               term->buffer + (i + start_row) * term->buffer_width,
-               (size_t) min_width * sizeof(char));
-    }
-    free(term->buffer);
-    term->buffer = new_buffer;
-    term->buffer_width = new_buffer_width;
-    term->buffer_height = new_buffer_height;// Update this only if you're changing the total rows count.
-    if (term->buffer_x >= new_buffer_width) {
-        term->buffer_x = 0;
-        term->buffer_y = term->buffer_y + 1;
-    }
-    if (term->buffer_y >= new_buffer_height) {
-        term->buffer_y = new_buffer_height - 1;
+/*!
+ * \brief Grow scratch rows of renderer to width of screen
+ */
+static bool term_reserve_scratch(term_t *term, int width) {
+    if (width <= term->scratch_width)
+        return true;
+    char *new_draw_line = realloc(term->draw_line, (size_t) width * sizeof(char));
+    if (new_draw_line)
+        term->draw_line = new_draw_line;
+    XChar2b *new_draw_line16 = realloc(term->draw_line16, (size_t) width * sizeof(XChar2b));
+    if (new_draw_line16)
+        term->draw_line16 = new_draw_line16;
+    uint32_t *new_view_chars = realloc(term->view_chars, (size_t) width * sizeof(uint32_t));
+    if (new_view_chars)
+        term->view_chars = new_view_chars;
+    term_attr_t *new_view_attrs = realloc(term->view_attrs, (size_t) width * sizeof(term_attr_t));
+    if (new_view_attrs)
+        term->view_attrs = new_view_attrs;
+    if (!new_draw_line || !new_draw_line16 || !new_view_chars || !new_view_attrs) {
+        perror("realloc");
+        return false;
     }
+    term->scratch_width = width;
     return true;
 }
 
 /*!
- * \brief Draw buffer on terminal
+ * \brief Get pixel of color index, colors are allocated on first use and cached
  */
-void term_draw(term_t *term) {
-    XSetForeground(term->display, term->graphics_context, term->color_bg);
-    XFillRectangle(term->display, term->window, term->graphics_context, 0, 0, (uint) term->width, (uint) term->height);
-    char ch = 0;
-    char *buf = &ch;
-    XSetForeground(term->display, term->graphics_context, term->color_fg);
-    for (int y = 0; y < term->buffer_height; y++) {
-        for (int x = 0; x < term->buffer_width; x++) {
-            *buf = term->buffer[y * term->buffer_width + x];
-
-            //printf("%d ", *buf);
-
-            // Filter non-printables
-            if (!IS_PRINTABLE_ASCII(*buf) /*&& !IS_PRINTABLE_UNICODE(buf[0])*/) {
-                continue;// Unicode replacement character <unknown>
-            }
-            XDrawString(term->display,
-                        term->window,
-                        term->graphics_context,
-                        (x * term->font_width),
-                        (y * term->font_height) + term->font->ascent + term->font->descent,
-                        buf,
-                        1);
-        }
-
-        //printf("\n");
+static unsigned long term_pixel(term_t *term, int index) {
+    if (index == COLOR_DEFAULT_FG)
+        return term->color_fg;
+    if (index == COLOR_DEFAULT_BG)
+        return term->color_bg;
+    if (!term->pixel_ready[index]) {
+        uint32_t rgb = term->palette.rgb[index];
+        XColor color = {
+            .red = (unsigned short) (((rgb >> 16) & 0xFF) * 257),
+            .green = (unsigned short) (((rgb >> 8) & 0xFF) * 257),
+            .blue = (unsigned short) ((rgb & 0xFF) * 257),
+            .flags = DoRed | DoGreen | DoBlue,
+        };
+        if (XAllocColor(term->display, DefaultColormap(term->display, term->screen), &color))
+            term->pixels[index] = color.pixel;
+        else
+            term->pixels[index] = term->color_fg;
+        term->pixel_ready[index] = true;
     }
+    return term->pixels[index];
+}
 
-    XSetForeground(term->display, term->graphics_context, term->color_cursor);
-    XFillRectangle(term->display,
-                   term->window,
-                   term->graphics_context,
-                   term->buffer_x * term->font_width,
-                   term->buffer_y * term->font_height,
-                   (uint) term->font_width,
-                   (uint) term->font_height + (uint) term->font->descent);
-
-    XFlush(term->display);
+/*!
+ * \brief Set colors of graphics context, requests are sent only for changed ones
+ */
+static void term_gc_colors(term_t *term, unsigned long fg, unsigned long bg) {
+    if (term->gc_fg != fg) {
+        XSetForeground(term->display, term->graphics_context, fg);
+        term->gc_fg = fg;
+    }
+    if (term->gc_bg != bg) {
+        XSetBackground(term->display, term->graphics_context, bg);
+        term->gc_bg = bg;
+    }
 }
 
 /*!
- * \brief Scroll terminal for one line
+ * \brief Check if font has glyph for codepoint of Basic Multilingual Plane
  */
-void term_scroll_buffer(term_t *term) {
-    memmove(term->buffer, &term->buffer[term->buffer_width], (size_t) term->buffer_width * (size_t) (term->buffer_height - 1));
-    term->buffer_y = term->buffer_height - 1;
-    for (int i = 0; i < term->buffer_width; i++)
-        term->buffer[term->buffer_y * term->buffer_width + i] = 0;
+static bool term_font_has_glyph(XFontStruct *font, uint32_t c) {
+    unsigned int byte1 = c >> 8;
+    unsigned int byte2 = c & 0xFF;
+    if (byte1 < font->min_byte1 || byte1 > font->max_byte1 || byte2 < font->min_char_or_byte2 ||
+        byte2 > font->max_char_or_byte2)
+        return false;
+    if (!font->per_char)
+        return true;
+    unsigned int columns = font->max_char_or_byte2 - font->min_char_or_byte2 + 1;
+    XCharStruct *metrics = &font->per_char[(byte1 - font->min_byte1) * columns + (byte2 - font->min_char_or_byte2)];
+    return metrics->width != 0 || metrics->ascent != 0 || metrics->descent != 0;
 }
 
 /*!
- * \brief Process data from PTY and changes buffer
+ * \brief Get glyph drawn for codepoint, missing glyphs are replaced
+ *  Font metrics are looked up once per codepoint, then the result is taken from `glyph_cache`
  */
-void term_output(term_t *term, char *buf, ssize_t n) {
-    // printf("Read:\n");
-    // for (ssize_t i = 0; i < n; i++) {
-    //     printf("%d ", buf[i]);
-    // }
-    // printf("\n");
+static XChar2b term_glyph(term_t *term, uint32_t c) {
+    uint16_t glyph = 0;
+    if (c <= 0xFFFF && term->glyph_cache[c]) {
+        glyph = term->glyph_cache[c];
+    } else {
+        if (c <= 0xFFFF && term_font_has_glyph(term->font, c))
+            glyph = (uint16_t) c;
+        else if (term_font_has_glyph(term->font, UTF8_REPLACEMENT))
+            glyph = UTF8_REPLACEMENT;
+        else
+            glyph = '?';
+        if (c <= 0xFFFF)
+            term->glyph_cache[c] = glyph;
+    }
+    return (XChar2b) {.byte1 = (unsigned char) (glyph >> 8), .byte2 = (unsigned char) (glyph & 0xFF)};
+}
 
-    for (ssize_t i = 0; i < n; i++) {
-        switch (buf[i]) {
-            case '\r': /* CR */
-                term->buffer_x = 0;
-                break;
-            case '\t': { /* HT */
-                int j = 0;
-                for (; (j < TAB_SIZE) && (term->buffer_x < term->buffer_width); j++) {
-                    term->buffer[term->buffer_y * term->buffer_width + term->buffer_x] = ' ';
-                    term->buffer_x++;
-                }
-                if (j != TAB_SIZE) {
-                    term->buffer_x = 0;
-                    term->buffer_y++;
-                    for (; j < TAB_SIZE; j++) {
-                        term->buffer[term->buffer_y * term->buffer_width + term->buffer_x] = ' ';
-                        term->buffer_x++;
-                    }
-                }
-            } break;
-            case '\b': { /* BR*/
-                if ((term->buffer_x == term->buffer_prompt_x) && (term->buffer_y == term->buffer_prompt_y))
-                    break;
-                term->buffer[term->buffer_y * term->buffer_width + term->buffer_x] = '\0';
-                term->buffer_x--;
-                if (term->buffer_x < 0) {
-                    term->buffer_x = term->buffer_width - 1;
-                    if (term->buffer_y != 0)
-                        term->buffer_y--;
-                }
-                term->buffer[term->buffer_y * term->buffer_width + term->buffer_x] = '\0';
-            } break;
-            case '\f': /* LF */
-            case '\v': /* VT */
-            case '\n': /* LF */
-                if (!just_wrapped) {
-                    term->buffer_y++;
-                    just_wrapped = false;
-                }
-                break;
-            case '\033': /* ESC */
-                i += term_parse_esc(term, buf + i) - 1;
-                break;
-            // Printable ASCII: Write to buffer and advance cursor
-            default:
-                if (IS_PRINTABLE_ASCII(buf[i])) {// ASCII printable range
-                    term->buffer[term->buffer_y * term->buffer_width + term->buffer_x] = buf[i];
-                    term->buffer_x++;
-                    if (term->buffer_x >= term->buffer_width) {
-                        term->buffer_x = 0;
-                        term->buffer_y++;
-                        just_wrapped = true;
-                    } else
-                        just_wrapped = false;
-                }
-                break;
+/*!
+ * \brief Draw cells with non-ASCII characters
+ *  Narrow characters are drawn as one 16-bit string, each double-width one gets its two cells painted first
+ *  and the glyph over them, so the grid holds whatever advance the font has.
+ */
+static void term_draw_unicode(term_t *term, int x, int baseline, const uint32_t *chars, int len) {
+    XChar2b *text = term->draw_line16 + x;
+    int narrow_begin = 0;
+    for (int i = 0; i < len; i++) {
+        bool wide = (i + 1 < len && chars[i + 1] == CELL_WIDE_TAIL);
+        if (!wide) {
+            uint32_t c = chars[i];
+            text[i] = (c == 0 || c == CELL_WIDE_TAIL) ? (XChar2b) {0, ' '} : term_glyph(term, c);
+            continue;
         }
-        // Scrolling buffer
-        if (term->buffer_y >= term->buffer_height) {
-            term_scroll_buffer(term);
-            term->buffer_y = term->buffer_height - 1;
+        if (i > narrow_begin) {
+            XDrawImageString16(term->display,
+                               term->back_buffer,
+                               term->graphics_context,
+                               (x + narrow_begin) * term->font_width,
+                               baseline,
+                               text + narrow_begin,
+                               i - narrow_begin);
         }
+        int wide_x = (x + i) * term->font_width;
+        text[i] = text[i + 1] = (XChar2b) {0, ' '};
+        XDrawImageString16(term->display, term->back_buffer, term->graphics_context, wide_x, baseline, text + i, 2);
+        text[i] = term_glyph(term, chars[i]);
+        XDrawString16(term->display, term->back_buffer, term->graphics_context, wide_x, baseline, text + i, 1);
+        narrow_begin = ++i + 1;
+    }
+    if (len > narrow_begin) {
+        XDrawImageString16(term->display,
+                           term->back_buffer,
+                           term->graphics_context,
+                           (x + narrow_begin) * term->font_width,
+                           baseline,
+                           text + narrow_begin,
+                           len - narrow_begin);
     }
 }
 
 /*!
- * \brief Process ESC sequences
- *  Note: now it can process only: `ESC [ H` `ESC [ 2 J` `ESC [ 3 J`
+ * \brief Draw one run of cells sharing attributes
+ *  XDrawImageString paints the glyph box background itself, so the run needs no separate clearing.
+ *  ASCII-only runs, the common case, are drawn with 8-bit string in a single request.
  */
-ssize_t term_parse_esc(term_t *term, char *buf) {
-    ssize_t curr_index = 0;
-    if (buf[curr_index] != '\033')
-        return 1;
-    curr_index++;
-    if (buf[curr_index] == '[') {
-        curr_index++;
-        /*
-            Now I process only `clear` sequences
-        */
-        // Check for "ESC [ H" (3 bytes)
-        if (buf[curr_index] == 'H') {
-            handle_cursor_home(term);
-            return curr_index + 1;
-        }
-        // Check for "ESC [ 2 J" (4 bytes)
-        if (buf[curr_index] == '2' && buf[curr_index + 1] == 'J') {
-            handle_clear_screen(term);
-            return curr_index + 2;
-        }
-        // Check for "ESC [ 2 J" (4 bytes)
-        if (buf[curr_index] == '3' && buf[curr_index + 1] == 'J') {
-            //TODO:
-            return curr_index + 2;
-        }
+static void term_draw_run(term_t *term, int x, int y, term_attr_t attr, const uint32_t *chars, int len) {
+    int fg = ATTR_FG(attr);
+    if ((attr & ATTR_BOLD) && fg < 8)
+        fg += 8;// Bold is shown as bright color
+    unsigned long fg_pixel = term_pixel(term, fg);
+    unsigned long bg_pixel = term_pixel(term, ATTR_BG(attr));
+    if (attr & ATTR_REVERSE) {
+        unsigned long swap = fg_pixel;
+        fg_pixel = bg_pixel;
+        bg_pixel = swap;
+    }
+    if (attr & ATTR_INVISIBLE)
+        fg_pixel = bg_pixel;
+    term_gc_colors(term, fg_pixel, bg_pixel);
+    int baseline = (y * term->font_height) + term->font->ascent + term->font->descent;
+    // Non-printables are drawn as blank cells to keep the run contiguous
+    char *text = term->draw_line + x;
+    uint32_t high = 0;
+    for (int i = 0; i < len; i++) {
+        high |= chars[i];
+        text[i] = IS_PRINTABLE_ASCII(chars[i]) ? (char) chars[i] : ' ';
+    }
+    if (high < 0x80)
+        XDrawImageString(term->display, term->back_buffer, term->graphics_context, x * term->font_width, baseline, text, len);
+    else
+        term_draw_unicode(term, x, baseline, chars, len);
+    if (attr & ATTR_UNDERLINE) {
+        XDrawLine(term->display,
+                  term->back_buffer,
+                  term->graphics_context,
+                  x * term->font_width,
+                  baseline + 1,
+                  (x + len) * term->font_width - 1,
+                  baseline + 1);
     }
-    // means error
-    return curr_index;
 }
 
 /*!
- * \brief Set cursor to (0,0)
+ * \brief Copy rectangle of back buffer to window, it also serves Expose without redrawing cells
  */
-void handle_cursor_home(term_t *term) {
-    term->buffer_x = 0;
-    term->buffer_y = 0;
+void term_present(term_t *term, int x, int y, int width, int height) {
+    XCopyArea(term->display, term->back_buffer, term->window, term->graphics_context, x, y, (uint) width, (uint) height, x, y);
 }
 
 /*!
- * \brief Clear window buffer`
+ * \brief (Re)create back buffer of window size, all cells are drawn into it on next frame
  */
-void handle_clear_screen(term_t *term) {
-    memset(term->buffer, '\0', (size_t) term->buffer_height * (size_t) term->buffer_width);
+void term_set_back_buffer(term_t *term) {
+    if (term->back_buffer)
+        XFreePixmap(term->display, term->back_buffer);
+    term->back_buffer = XCreatePixmap(term->display,
+                                      term->window,
+                                      (uint) MAX(term->width, 1),
+                                      (uint) MAX(term->height, 1),
+                                      (uint) DefaultDepth(term->display, term->screen));
+    screen_damage_all(term->model);
+}
+
+/*!
+ * \brief Draw changed parts of buffer on terminal
+ *  Damaged spans are repainted into back buffer, then changed rows are copied to window at once.
+ *  Full repaint happens after `screen_damage_all`.
+ */
+void term_draw(term_t *term) {
+    screen_t *screen = term->model;
+    if (!term_reserve_scratch(term, screen->buffer_width))
+        return;
+    uint64_t draw_begin = term->print_stats ? stats_now() : 0;
+    unsigned long request_first = XNextRequest(term->display);
+    // Rows [present_begin, present_end) of back buffer are copied to window at the end
+    bool present_all = false;
+    int present_begin = screen->buffer_height;
+    int present_end = 0;
+    if (screen->damage_all) {
+        // Glyph boxes never cover the gap above each row, so whole window is cleared only here
+        term_gc_colors(term, term->color_bg, term->gc_bg);
+        XFillRectangle(term->display, term->back_buffer, term->graphics_context, 0, 0, (uint) term->width, (uint) term->height);
+        screen->damage_all = false;
+        screen->scroll_pending = 0;
+        present_all = true;
+    }
+    // Scrolled back view is shifted against the screen, so it's repainted whole
+    if (screen->view_offset > 0 || screen->view_changed) {
+        screen_damage_rows(screen, 0, screen->buffer_height);
+        screen->scroll_pending = 0;
+        screen->view_changed = false;
+    }
+    // Move pixels of rows that only scrolled instead of redrawing them
+    if (screen->scroll_pending > 0) {
+        if (screen->scroll_pending < screen->buffer_height) {
+            XCopyArea(term->display,
+                      term->back_buffer,
+                      term->back_buffer,
+                      term->graphics_context,
+                      0,
+                      screen->scroll_pending * term->font_height,
+                      (uint) term->width,
+                      (uint) ((screen->buffer_height - screen->scroll_pending) * term->font_height),
+                      0,
+                      0);
+        }
+        term->cursor_drawn_y -= screen->scroll_pending;
+        screen->scroll_pending = 0;
+        present_all = true;
+    }
+    // Old cursor must be erased
+    screen_damage(screen, term->cursor_drawn_y, term->cursor_drawn_x, term->cursor_drawn_x + 1);
+
+    for (int y = 0; y < screen->buffer_height; y++) {
+        if (screen->damage_begin[y] >= screen->damage_end[y])
+            continue;
+        term_row_t row = term_view_row(term, y);
+        // Selection is drawn reversed, attributes are copied so the model keeps its own
+        int select_begin, select_end;
+        if (select_span(screen, y, &select_begin, &select_end)) {
+            if (row.attrs != term->view_attrs) {
+                memcpy(term->view_attrs, row.attrs, (size_t) screen->buffer_width * sizeof(term_attr_t));
+                row.attrs = term->view_attrs;
+            }
+            for (int x = select_begin; x < select_end; x++)
+                row.attrs[x] ^= ATTR_REVERSE;
+        }
+        // Double-width character is drawn whole even if only one half is damaged
+        int begin = screen->damage_begin[y];
+        int end = screen->damage_end[y];
+        if (begin > 0 && row.chars[begin] == CELL_WIDE_TAIL)
+            begin--;
+        if (end < screen->buffer_width && row.chars[end] == CELL_WIDE_TAIL)
+            end++;
+        // Span is split into runs of equal attributes
+        int x = begin;
+        while (x < end) {
+            term_attr_t attr = row.attrs[x];
+            int run_end = x + 1;
+            while (run_end < end && row.attrs[run_end] == attr)
+                run_end++;
+            term_draw_run(term, x, y, attr, row.chars + x, run_end - x);
+            x = run_end;
+        }
+        screen->damage_begin[y] = screen->damage_end[y] = 0;
+        present_begin = MIN(present_begin, y);
+        present_end = y + 1;
+    }
+
+    int cursor_view_y = screen->buffer_y + (int) screen->view_offset;
+    if (screen->cursor_hidden || term->cursor_blink_off || cursor_view_y >= screen->buffer_height) {
+        term->cursor_drawn_y = -1;
+    } else {
+        term_gc_colors(term, term->color_cursor, term->gc_bg);
+        XFillRectangle(term->display,
+                       term->back_buffer,
+                       term->graphics_context,
+                       screen->buffer_x * term->font_width,
+                       cursor_view_y * term->font_height + term->font->descent,
+                       (uint) term->font_width,
+                       (uint) (term->font->ascent + term->font->descent));
+        term->cursor_drawn_x = screen->buffer_x;
+        term->cursor_drawn_y = cursor_view_y;
+        present_begin = MIN(present_begin, cursor_view_y);
+        present_end = MAX(present_end, cursor_view_y + 1);
+    }
+    // Frame is shown with a single copy, window never has half-drawn content
+    if (present_all)
+        term_present(term, 0, 0, term->width, term->height);
+    else if (present_begin < present_end)
+        term_present(term,
+                     0,
+                     present_begin * term->font_height,
+                     term->width,
+                     (present_end - present_begin) * term->font_height);
+
+    term->stats_frames++;
+    term->stats_requests += XNextRequest(term->display) - request_first;
+    XFlush(term->display);
+    if (term->print_stats)
+        stats_frame(&term->stats, stats_now() - draw_begin);
 }
 
 /*!
@@ -328,15 +467,21 @@ void term_set_color(term_t *term) {
     term->color_bg = color.pixel;
     XAllocNamedColor(term->display, cmap, term->hex_color_cursor, &color, &color);// load cursor color
     term->color_cursor = color.pixel;
+    // Palette colors are allocated when they are drawn first time
+    palette_init(&term->palette);
 }
 
 /*!
  * \brief Create fonts
  */
-void term_set_font(term_t *term) {
-    if (!term->font_name)
+bool term_set_font(term_t *term) {
+    if (!term->font_name) {
         term->font_name = DEFAULT_FONT;
-    term->font = XLoadQueryFont(term->display, term->font_name);
+        // Unicode encoding of default font is preferred, it has Cyrillic and box drawing glyphs
+        term->font = XLoadQueryFont(term->display, DEFAULT_FONT_UNICODE);
+    }
+    if (!term->font)
+        term->font = XLoadQueryFont(term->display, term->font_name);
     if (!term->font) {
         fprintf(stderr, "Can't load font \"%s\"! Switch to default \"" DEFAULT_FONT "\"\n", term->font_name);
         term->font_name = DEFAULT_FONT;
@@ -345,6 +490,13 @@ void term_set_font(term_t *term) {
     // Get font characters width and height
     term->font_width = term->font->max_bounds.width;
     term->font_height = term->font->ascent + term->font->descent * 2;// Total vertical space
+    // Glyphs are resolved lazily for each codepoint of Basic Multilingual Plane
+    term->glyph_cache = calloc(0x10000, sizeof(uint16_t));
+    if (!term->glyph_cache) {
+        perror("calloc");
+        return false;
+    }
+    return true;
 }
 
 /*!
@@ -355,18 +507,11 @@ bool term_set_buffer(term_t *term) {
     int max_width = DisplayWidth(term->display, term->screen) / term->font_width;
     int max_height = DisplayHeight(term->display, term->screen) / term->font_height;
     // Buffer
-    term->buffer_width = (term->buffer_width > 0) ? term->buffer_width : DEFAULT_WIDTH;
-    term->buffer_height = (term->buffer_height > 0) ? term->buffer_height : DEFAULT_HEIGHT;
-    if (max_width <= term->buffer_width)
-        term->buffer_width = max_width;
-    if (max_height <= term->buffer_height)
-        term->buffer_height = max_height;
-    term->buffer_x = 0;
-    term->buffer_y = 0;
-    term->buffer = calloc((long unsigned int) term->buffer_width * (long unsigned int) term->buffer_height, sizeof(char));
-    if (!term->buffer) {
-        perror("calloc");
-        return false;
-    }
-    return true;
+    int buffer_width = (term->option_width > 0) ? term->option_width : DEFAULT_WIDTH;
+    int buffer_height = (term->option_height > 0) ? term->option_height : DEFAULT_HEIGHT;
+    if (max_width <= buffer_width)
+        buffer_width = max_width;
+    if (max_height <= buffer_height)
+        buffer_height = max_height;
+    return screen_init(term->model, &term->palette, buffer_width, buffer_height, (size_t) term->history_size * 1024);
 }
\ No newline at end of file
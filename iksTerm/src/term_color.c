@@ -0,0 +1,55 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <main.h>
+#include <term_color.h>
+
+/*!
+ * \brief Standard xterm colors for the first 16 indices
+ */
+static const uint32_t palette_ansi[16] = {
+    0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+    0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff,
+};
+
+/*!
+ * \brief Fill 256 indexed colors
+ */
+void palette_init(term_palette_t *palette) {
+    memset(palette, 0, sizeof(*palette));
+    memcpy(palette->rgb, palette_ansi, sizeof(palette_ansi));
+    // 6x6x6 color cube
+    for (int i = 0; i < 216; i++) {
+        int r = i / 36, g = (i / 6) % 6, b = i % 6;
+        uint32_t red = r ? (uint32_t) (55 + r * 40) : 0;
+        uint32_t green = g ? (uint32_t) (55 + g * 40) : 0;
+        uint32_t blue = b ? (uint32_t) (55 + b * 40) : 0;
+        palette->rgb[16 + i] = (red << 16) | (green << 8) | blue;
+    }
+    // Grayscale ramp
+    for (int i = 0; i < 24; i++) {
+        uint32_t level = (uint32_t) (8 + i * 10);
+        palette->rgb[232 + i] = (level << 16) | (level << 8) | level;
+    }
+}
+
+/*!
+ * \brief Get index of truecolor value, new values take free indices
+ *  When indices are over, the nearest color of 6x6x6 cube is used
+ */
+int palette_truecolor(term_palette_t *palette, int red, int green, int blue) {
+    uint32_t rgb = ((uint32_t) red << 16) | ((uint32_t) green << 8) | (uint32_t) blue;
+    uint32_t slot = (rgb * 2654435761u) & (COLOR_LOOKUP_SIZE - 1);
+    while (palette->lookup[slot]) {
+        if (palette->rgb[palette->lookup[slot]] == rgb)
+            return palette->lookup[slot];
+        slot = (slot + 1) & (COLOR_LOOKUP_SIZE - 1);
+    }
+    if (COLOR_TRUECOLOR_FIRST + palette->truecolor_count >= COLOR_COUNT)
+        return 16 + 36 * ((red * 5 + 127) / 255) + 6 * ((green * 5 + 127) / 255) + (blue * 5 + 127) / 255;
+    int index = COLOR_TRUECOLOR_FIRST + palette->truecolor_count++;
+    palette->rgb[index] = rgb;
+    palette->lookup[slot] = (uint16_t) index;
+    return index;
+}
@@ -0,0 +1,288 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+
+/*!
+ * @struct history_line_t
+ * @brief Header of line in chunk, it's followed by attribute runs and characters
+ */
+typedef struct history_line_t {
+    uint16_t length;  ///< Number of cells
+    uint16_t runs;    ///< Number of attribute runs
+    uint8_t char_size;///< Bytes per character: 1 for ASCII-only line, 4 otherwise
+    uint8_t flags;    ///< HISTORY_WRAPPED
+} history_line_t;
+
+/**
+ * @brief Defines the flag of line that continues on the next one (soft wrap).
+ */
+#define HISTORY_WRAPPED 0x01
+
+/**
+ * @brief Defines the size of attribute run in chunk: count (uint16_t) and attributes (term_attr_t).
+ */
+#define HISTORY_RUN_SIZE (sizeof(uint16_t) + sizeof(term_attr_t))
+
+/*!
+ * \brief Setup empty history with budget in bytes
+ */
+bool history_init(term_history_t *history, size_t budget) {
+    *history = (term_history_t) {};
+    history->chunk_limit = MAX(budget / HISTORY_CHUNK_SIZE, 1);
+    history->line_capacity = 1024;
+    history->lines = malloc(history->line_capacity * sizeof(char *));
+    if (!history->lines) {
+        perror("malloc");
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief Drop the oldest chunk with all lines started in it, chunk is returned for reuse
+ */
+static history_chunk_t *history_evict(term_history_t *history) {
+    history_chunk_t *chunk = history->oldest;
+    history->oldest = chunk->next;
+    if (!history->oldest)
+        history->newest = NULL;
+    history->line_head = (history->line_head + chunk->lines) % history->line_capacity;
+    history->line_count -= chunk->lines;
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->lines = 0;
+    return chunk;
+}
+
+/*!
+ * \brief Get chunk with free space for size bytes, evicting the oldest one when budget is over
+ */
+static history_chunk_t *history_reserve(term_history_t *history, size_t size) {
+    if (history->newest && history->newest->used + size <= HISTORY_CHUNK_SIZE)
+        return history->newest;
+    history_chunk_t *chunk = NULL;
+    if (history->chunk_count >= history->chunk_limit && history->oldest) {
+        chunk = history_evict(history);
+    } else {
+        chunk = malloc(sizeof(history_chunk_t) + HISTORY_CHUNK_SIZE);
+        if (!chunk) {
+            perror("malloc");
+            return NULL;
+        }
+        *chunk = (history_chunk_t) {};
+        history->chunk_count++;
+    }
+    if (history->newest)
+        history->newest->next = chunk;
+    else
+        history->oldest = chunk;
+    history->newest = chunk;
+    return chunk;
+}
+
+/*!
+ * \brief Check if cell looks the same as never written one, such cells are trimmed at line end
+ */
+static bool history_blank_cell(uint32_t c, term_attr_t attr) {
+    return (c == 0 || c == ' ') && ATTR_BG(attr) == COLOR_DEFAULT_BG && !(attr & (ATTR_REVERSE | ATTR_UNDERLINE));
+}
+
+/*!
+ * \brief Append line to history, trailing blanks are trimmed unless line is wrapped
+ *  Attributes are stored as runs and characters take one byte each when line is ASCII-only,
+ *  so plain text costs about as much as before cells had attributes.
+ *  Wrapped line is flagged, so reflow can join it with the next one.
+ */
+bool history_push(term_history_t *history, const uint32_t *chars, const term_attr_t *attrs, int length, bool wrapped) {
+    if (!history->lines)
+        return false;
+    // Spaces of wrapped line are its text, only padding left by double-width character is dropped
+    while (length > 0 && (wrapped ? chars[length - 1] == 0 && attrs[length - 1] == ATTR_DEFAULT
+                                  : history_blank_cell(chars[length - 1], attrs[length - 1])))
+        length--;
+    history_line_t header = {.length = (uint16_t) length, .char_size = 1, .flags = wrapped ? HISTORY_WRAPPED : 0};
+    for (int x = 0; x < length; x++) {
+        if (x == 0 || attrs[x] != attrs[x - 1])
+            header.runs++;
+        if (chars[x] > 0xFF)
+            header.char_size = sizeof(uint32_t);
+    }
+    size_t size = sizeof(history_line_t) + header.runs * HISTORY_RUN_SIZE + (size_t) length * header.char_size;
+    history_chunk_t *chunk = history_reserve(history, size);
+    if (!chunk)
+        return false;
+    // Lines ring is full only while budget is not reached, so it grows a bounded number of times
+    if (history->line_count == history->line_capacity) {
+        char **new_lines = malloc(history->line_capacity * 2 * sizeof(char *));
+        if (!new_lines) {
+            perror("malloc");
+            return false;
+        }
+        for (size_t i = 0; i < history->line_count; i++)
+            new_lines[i] = history->lines[(history->line_head + i) % history->line_capacity];
+        free(history->lines);
+        history->lines = new_lines;
+        history->line_capacity *= 2;
+        history->line_head = 0;
+    }
+    char *line = chunk->data + chunk->used;
+    char *write = line;
+    memcpy(write, &header, sizeof(history_line_t));
+    write += sizeof(history_line_t);
+    for (int x = 0; x < length;) {
+        int run_end = x + 1;
+        while (run_end < length && attrs[run_end] == attrs[x])
+            run_end++;
+        uint16_t count = (uint16_t) (run_end - x);
+        memcpy(write, &count, sizeof(uint16_t));
+        memcpy(write + sizeof(uint16_t), &attrs[x], sizeof(term_attr_t));
+        write += HISTORY_RUN_SIZE;
+        x = run_end;
+    }
+    if (header.char_size == 1) {
+        for (int x = 0; x < length; x++)
+            *write++ = (char) chars[x];
+    } else {
+        memcpy(write, chars, (size_t) length * sizeof(uint32_t));
+    }
+    chunk->used += size;
+    chunk->lines++;
+    history->lines[(history->line_head + history->line_count) % history->line_capacity] = line;
+    history->line_count++;
+    history->line_total++;
+    return true;
+}
+
+/*!
+ * \brief Expand line by age (0 is the most recent one) into cells, rest of width is blank
+ */
+bool history_get(term_history_t *history, size_t age, uint32_t *chars, term_attr_t *attrs, int width) {
+    int x = 0;
+    bool found = age < history->line_count;
+    if (found) {
+        const char *read = history->lines[(history->line_head + history->line_count - 1 - age) % history->line_capacity];
+        history_line_t header = {};
+        memcpy(&header, read, sizeof(history_line_t));
+        read += sizeof(history_line_t);
+        int length = MIN((int) header.length, width);
+        for (int run = 0; run < header.runs; run++) {
+            uint16_t count = 0;
+            term_attr_t attr = 0;
+            memcpy(&count, read, sizeof(uint16_t));
+            memcpy(&attr, read + sizeof(uint16_t), sizeof(term_attr_t));
+            read += HISTORY_RUN_SIZE;
+            for (int i = 0; i < count && x < length; i++)
+                attrs[x++] = attr;
+        }
+        if (header.char_size == 1) {
+            for (int i = 0; i < length; i++)
+                chars[i] = (unsigned char) read[i];
+        } else {
+            memcpy(chars, read, (size_t) length * sizeof(uint32_t));
+        }
+        x = length;
+    }
+    for (; x < width; x++) {
+        chars[x] = 0;
+        attrs[x] = ATTR_DEFAULT;
+    }
+    return found;
+}
+
+/*!
+ * \brief Get length of line by age (0 is the most recent one) and whether it's wrapped, -1 if there is no such line
+ */
+int history_line(term_history_t *history, size_t age, bool *wrapped) {
+    if (age >= history->line_count)
+        return -1;
+    history_line_t header = {};
+    memcpy(&header, history->lines[(history->line_head + history->line_count - 1 - age) % history->line_capacity],
+           sizeof(history_line_t));
+    *wrapped = header.flags & HISTORY_WRAPPED;
+    return header.length;
+}
+
+/*!
+ * \brief Get stored characters of line by age without expanding them, NULL if there is no such line
+ *  Characters take char_size bytes each, so search can run over the arena as is.
+ */
+const char *history_text(term_history_t *history, size_t age, int *length, int *char_size) {
+    if (age >= history->line_count)
+        return NULL;
+    const char *read = history->lines[(history->line_head + history->line_count - 1 - age) % history->line_capacity];
+    history_line_t header = {};
+    memcpy(&header, read, sizeof(history_line_t));
+    *length = header.length;
+    *char_size = header.char_size;
+    return read + sizeof(history_line_t) + header.runs * HISTORY_RUN_SIZE;
+}
+
+/*!
+ * \brief Drop the most recent line, it's taken back to the screen by reflow
+ *  Space is returned when line is at the end of the newest chunk, otherwise it's freed with its chunk.
+ */
+void history_pop(term_history_t *history) {
+    if (history->line_count == 0)
+        return;
+    history->line_count--;
+    history->line_total--;
+    char *line = history->lines[(history->line_head + history->line_count) % history->line_capacity];
+    history_chunk_t *newest = history->newest;
+    if (newest->lines > 0 && line >= newest->data && line < newest->data + newest->used) {
+        newest->lines--;
+        newest->used = (size_t) (line - newest->data);
+        return;
+    }
+    // Newest chunk was emptied by previous pops, line is in an older one
+    for (history_chunk_t *chunk = history->oldest; chunk; chunk = chunk->next) {
+        if (chunk->lines > 0 && line >= chunk->data && line < chunk->data + chunk->used) {
+            chunk->lines--;
+            return;
+        }
+    }
+}
+
+/*!
+ * \brief Forget all lines, chunks are kept for reuse
+ */
+void history_clear(term_history_t *history) {
+    for (history_chunk_t *chunk = history->oldest; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+        chunk->lines = 0;
+    }
+    if (history->oldest)
+        history->newest = history->oldest;
+    if (history->newest) {
+        // Keep a single empty chunk, others are freed
+        history_chunk_t *chunk = history->newest->next;
+        while (chunk) {
+            history_chunk_t *next = chunk->next;
+            free(chunk);
+            history->chunk_count--;
+            chunk = next;
+        }
+        history->newest->next = NULL;
+    }
+    history->line_head = 0;
+    history->line_count = 0;
+}
+
+/*!
+ * \brief Free all memory of history
+ */
+void history_destroy(term_history_t *history) {
+    history_chunk_t *chunk = history->oldest;
+    while (chunk) {
+        history_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(history->lines);
+    *history = (term_history_t) {};
+}
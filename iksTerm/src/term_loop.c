@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <main.h>
+#include <term_loop.h>
+
+/*!
+ * \brief Create epoll instance with empty source slots
+ */
+bool loop_init(term_loop_t *loop) {
+    loop->fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->fd_epoll == -1) {
+        perror("epoll_create1");
+        return false;
+    }
+    for (int i = 0; i < LOOP_MAX_SOURCES; i++)
+        loop->sources[i] = (loop_source_t) {.fd = -1};
+    loop->deferred_count = 0;
+    loop->running = false;
+    return true;
+}
+
+/*!
+ * \brief Register fd with epoll flags (EPOLLIN, EPOLLET...), returns its source or NULL on error
+ */
+loop_source_t *loop_add(term_loop_t *loop, int fd, uint32_t events, loop_handler_t handler, void *data) {
+    loop_source_t *source = NULL;
+    for (int i = 0; i < LOOP_MAX_SOURCES && !source; i++)
+        if (loop->sources[i].fd == -1)
+            source = &loop->sources[i];
+    if (!source) {
+        fprintf(stderr, "Too many sources in event loop\n");
+        return NULL;
+    }
+    struct epoll_event event = {.events = events, .data.ptr = source};
+    if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("epoll_ctl");
+        return NULL;
+    }
+    *source = (loop_source_t) {.fd = fd, .handler = handler, .events = events, .data = data};
+    return source;
+}
+
+/*!
+ * \brief Change epoll flags fd of source is watched for (e.g. add EPOLLOUT while output is queued)
+ */
+bool loop_modify(term_loop_t *loop, loop_source_t *source, uint32_t events) {
+    if (source->events == events)
+        return true;
+    struct epoll_event event = {.events = events, .data.ptr = source};
+    if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_MOD, source->fd, &event) == -1) {
+        perror("epoll_ctl");
+        return false;
+    }
+    source->events = events;
+    return true;
+}
+
+/*!
+ * \brief Unregister source, fd itself is left open
+ */
+void loop_remove(term_loop_t *loop, loop_source_t *source) {
+    if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_DEL, source->fd, NULL) == -1)
+        perror("epoll_ctl");
+    if (source->deferred)
+        loop->deferred_count--;
+    *source = (loop_source_t) {.fd = -1};
+}
+
+/*!
+ * \brief Call handler of source again on the next iteration without waiting
+ *  Edge-triggered fd doesn't report data left after handler stopped early, so handler defers itself instead.
+ */
+void loop_defer(term_loop_t *loop, loop_source_t *source) {
+    if (!source->deferred) {
+        source->deferred = true;
+        loop->deferred_count++;
+    }
+}
+
+/*!
+ * \brief Dispatch events until handler stops the loop, returns false on error of epoll
+ */
+bool loop_run(term_loop_t *loop) {
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    loop_source_t *deferred[LOOP_MAX_SOURCES];
+    loop->running = true;
+    while (loop->running) {
+        // Deferred work is taken before waiting, so handlers can defer themselves again
+        int deferred_count = 0;
+        if (loop->deferred_count > 0) {
+            for (int i = 0; i < LOOP_MAX_SOURCES; i++) {
+                if (loop->sources[i].deferred) {
+                    loop->sources[i].deferred = false;
+                    deferred[deferred_count++] = &loop->sources[i];
+                }
+            }
+            loop->deferred_count = 0;
+        }
+        int n = epoll_wait(loop->fd_epoll, events, LOOP_MAX_EVENTS, deferred_count ? 0 : -1);
+        if (n == -1) {
+            if (errno != EINTR) {
+                perror("epoll_wait");
+                return false;
+            }
+            n = 0;
+        }
+        for (int i = 0; i < n && loop->running; i++) {
+            loop_source_t *source = events[i].data.ptr;
+            if (source->fd != -1)
+                source->handler(loop, source->data, events[i].events);
+        }
+        for (int i = 0; i < deferred_count && loop->running; i++)
+            if (deferred[i]->fd != -1)
+                deferred[i]->handler(loop, deferred[i]->data, EPOLLIN);
+    }
+    return true;
+}
+
+/*!
+ * \brief Close epoll instance
+ */
+void loop_destroy(term_loop_t *loop) {
+    close(loop->fd_epoll);
+    loop->fd_epoll = -1;
+}
+
+/*!
+ * \brief Create disarmed monotonic timer, returns fd or -1
+ */
+int loop_timer_new() {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1)
+        perror("timerfd_create");
+    return fd;
+}
+
+/*!
+ * \brief Arm timer to fire after delay and then every interval (0 for one shot), zero delay disarms it
+ */
+bool loop_timer_set(int fd, unsigned long delay_us, unsigned long interval_us) {
+    struct itimerspec spec = {
+        .it_value = {.tv_sec = (time_t) (delay_us / 1000000UL), .tv_nsec = (long) (delay_us % 1000000UL) * 1000},
+        .it_interval = {.tv_sec = (time_t) (interval_us / 1000000UL), .tv_nsec = (long) (interval_us % 1000000UL) * 1000},
+    };
+    if (timerfd_settime(fd, 0, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief Read number of expirations since the last call
+ */
+uint64_t loop_timer_ack(int fd) {
+    uint64_t expirations = 0;
+    if (read(fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+        perror("read(timerfd)");
+    return expirations;
+}
@@ -0,0 +1,645 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+#include <term_utf8.h>
+#include <term_parser.h>
+#include <term_select.h>
+#include <term_screen.h>
+#include <term_scan.h>
+
+/*!
+ * @struct parser_transition_t
+ * @brief Cell of state table: what to do with byte and where to go
+ */
+typedef struct parser_transition_t {
+    unsigned char action;///< parser_action_t
+    unsigned char state; ///< parser_state_t or STATE_KEEP
+} parser_transition_t;
+
+static parser_transition_t parser_table[STATE_COUNT][256];
+static parser_action_t parser_entry_action[STATE_COUNT];
+static parser_action_t parser_exit_action[STATE_COUNT];
+static bool parser_table_ready = false;
+
+/*!
+ * \brief Fill table for bytes [from, to] of state
+ */
+static void parser_table_set(parser_state_t state, int from, int to, parser_action_t action, parser_state_t next) {
+    for (int c = from; c <= to; c++) {
+        parser_table[state][c].action = (unsigned char) action;
+        parser_table[state][c].state = (unsigned char) next;
+    }
+}
+
+/*!
+ * \brief Fill table for C0 controls of state, except of "anywhere" ones
+ */
+static void parser_table_set_c0(parser_state_t state, parser_action_t action) {
+    parser_table_set(state, 0x00, 0x17, action, STATE_KEEP);
+    parser_table_set(state, 0x19, 0x19, action, STATE_KEEP);
+    parser_table_set(state, 0x1C, 0x1F, action, STATE_KEEP);
+}
+
+/*!
+ * \brief Build state table once
+ *  Note: 8-bit C1 controls are not recognized, bytes >= 0x80 are text (UTF-8) in ground state
+ */
+void term_parser_init() {
+    if (parser_table_ready)
+        return;
+    for (int state = 0; state < STATE_COUNT; state++) {
+        parser_table_set(state, 0x00, 0xFF, ACTION_IGNORE, STATE_KEEP);
+        // Transitions from anywhere
+        parser_table_set(state, 0x18, 0x18, ACTION_EXECUTE, STATE_GROUND);
+        parser_table_set(state, 0x1A, 0x1A, ACTION_EXECUTE, STATE_GROUND);
+        parser_table_set(state, 0x1B, 0x1B, ACTION_IGNORE, STATE_ESCAPE);
+    }
+    // Ground
+    parser_table_set_c0(STATE_GROUND, ACTION_EXECUTE);
+    parser_table_set(STATE_GROUND, 0x20, 0x7E, ACTION_PRINT, STATE_KEEP);
+    parser_table_set(STATE_GROUND, 0x80, 0xFF, ACTION_PRINT, STATE_KEEP);
+    // Escape
+    parser_table_set_c0(STATE_ESCAPE, ACTION_EXECUTE);
+    parser_table_set(STATE_ESCAPE, 0x20, 0x2F, ACTION_COLLECT, STATE_ESCAPE_INTERMEDIATE);
+    parser_table_set(STATE_ESCAPE, 0x30, 0x7E, ACTION_ESC_DISPATCH, STATE_GROUND);
+    parser_table_set(STATE_ESCAPE, 0x50, 0x50, ACTION_IGNORE, STATE_DCS_ENTRY);
+    parser_table_set(STATE_ESCAPE, 0x58, 0x58, ACTION_IGNORE, STATE_SOS_PM_APC_STRING);
+    parser_table_set(STATE_ESCAPE, 0x5B, 0x5B, ACTION_IGNORE, STATE_CSI_ENTRY);
+    parser_table_set(STATE_ESCAPE, 0x5D, 0x5D, ACTION_IGNORE, STATE_OSC_STRING);
+    parser_table_set(STATE_ESCAPE, 0x5E, 0x5F, ACTION_IGNORE, STATE_SOS_PM_APC_STRING);
+    // Escape intermediate
+    parser_table_set_c0(STATE_ESCAPE_INTERMEDIATE, ACTION_EXECUTE);
+    parser_table_set(STATE_ESCAPE_INTERMEDIATE, 0x20, 0x2F, ACTION_COLLECT, STATE_KEEP);
+    parser_table_set(STATE_ESCAPE_INTERMEDIATE, 0x30, 0x7E, ACTION_ESC_DISPATCH, STATE_GROUND);
+    // CSI entry
+    parser_table_set_c0(STATE_CSI_ENTRY, ACTION_EXECUTE);
+    parser_table_set(STATE_CSI_ENTRY, 0x20, 0x2F, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+    parser_table_set(STATE_CSI_ENTRY, 0x30, 0x39, ACTION_PARAM, STATE_CSI_PARAM);
+    parser_table_set(STATE_CSI_ENTRY, 0x3A, 0x3B, ACTION_PARAM, STATE_CSI_PARAM);
+    parser_table_set(STATE_CSI_ENTRY, 0x3C, 0x3F, ACTION_COLLECT, STATE_CSI_PARAM);
+    parser_table_set(STATE_CSI_ENTRY, 0x40, 0x7E, ACTION_CSI_DISPATCH, STATE_GROUND);
+    // CSI param
+    parser_table_set_c0(STATE_CSI_PARAM, ACTION_EXECUTE);
+    parser_table_set(STATE_CSI_PARAM, 0x20, 0x2F, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+    parser_table_set(STATE_CSI_PARAM, 0x30, 0x39, ACTION_PARAM, STATE_KEEP);
+    parser_table_set(STATE_CSI_PARAM, 0x3A, 0x3B, ACTION_PARAM, STATE_KEEP);
+    parser_table_set(STATE_CSI_PARAM, 0x3C, 0x3F, ACTION_IGNORE, STATE_CSI_IGNORE);
+    parser_table_set(STATE_CSI_PARAM, 0x40, 0x7E, ACTION_CSI_DISPATCH, STATE_GROUND);
+    // CSI intermediate
+    parser_table_set_c0(STATE_CSI_INTERMEDIATE, ACTION_EXECUTE);
+    parser_table_set(STATE_CSI_INTERMEDIATE, 0x20, 0x2F, ACTION_COLLECT, STATE_KEEP);
+    parser_table_set(STATE_CSI_INTERMEDIATE, 0x30, 0x3F, ACTION_IGNORE, STATE_CSI_IGNORE);
+    parser_table_set(STATE_CSI_INTERMEDIATE, 0x40, 0x7E, ACTION_CSI_DISPATCH, STATE_GROUND);
+    // CSI ignore
+    parser_table_set_c0(STATE_CSI_IGNORE, ACTION_EXECUTE);
+    parser_table_set(STATE_CSI_IGNORE, 0x40, 0x7E, ACTION_IGNORE, STATE_GROUND);
+    // DCS entry, DCS strings are recognized and skipped
+    parser_table_set(STATE_DCS_ENTRY, 0x20, 0x2F, ACTION_COLLECT, STATE_DCS_INTERMEDIATE);
+    parser_table_set(STATE_DCS_ENTRY, 0x30, 0x39, ACTION_PARAM, STATE_DCS_PARAM);
+    parser_table_set(STATE_DCS_ENTRY, 0x3A, 0x3A, ACTION_IGNORE, STATE_DCS_IGNORE);
+    parser_table_set(STATE_DCS_ENTRY, 0x3B, 0x3B, ACTION_PARAM, STATE_DCS_PARAM);
+    parser_table_set(STATE_DCS_ENTRY, 0x3C, 0x3F, ACTION_COLLECT, STATE_DCS_PARAM);
+    parser_table_set(STATE_DCS_ENTRY, 0x40, 0x7E, ACTION_IGNORE, STATE_DCS_PASSTHROUGH);
+    // DCS param
+    parser_table_set(STATE_DCS_PARAM, 0x20, 0x2F, ACTION_COLLECT, STATE_DCS_INTERMEDIATE);
+    parser_table_set(STATE_DCS_PARAM, 0x30, 0x39, ACTION_PARAM, STATE_KEEP);
+    parser_table_set(STATE_DCS_PARAM, 0x3A, 0x3A, ACTION_IGNORE, STATE_DCS_IGNORE);
+    parser_table_set(STATE_DCS_PARAM, 0x3B, 0x3B, ACTION_PARAM, STATE_KEEP);
+    parser_table_set(STATE_DCS_PARAM, 0x3C, 0x3F, ACTION_IGNORE, STATE_DCS_IGNORE);
+    parser_table_set(STATE_DCS_PARAM, 0x40, 0x7E, ACTION_IGNORE, STATE_DCS_PASSTHROUGH);
+    // DCS intermediate
+    parser_table_set(STATE_DCS_INTERMEDIATE, 0x20, 0x2F, ACTION_COLLECT, STATE_KEEP);
+    parser_table_set(STATE_DCS_INTERMEDIATE, 0x30, 0x3F, ACTION_IGNORE, STATE_DCS_IGNORE);
+    parser_table_set(STATE_DCS_INTERMEDIATE, 0x40, 0x7E, ACTION_IGNORE, STATE_DCS_PASSTHROUGH);
+    // OSC string, terminated by ST (ESC \) or BEL like xterm does
+    parser_table_set(STATE_OSC_STRING, 0x07, 0x07, ACTION_IGNORE, STATE_GROUND);
+    parser_table_set(STATE_OSC_STRING, 0x20, 0xFF, ACTION_OSC_PUT, STATE_KEEP);
+    // Entry and exit actions
+    parser_entry_action[STATE_ESCAPE] = ACTION_CLEAR;
+    parser_entry_action[STATE_CSI_ENTRY] = ACTION_CLEAR;
+    parser_entry_action[STATE_DCS_ENTRY] = ACTION_CLEAR;
+    parser_entry_action[STATE_OSC_STRING] = ACTION_OSC_START;
+    parser_exit_action[STATE_OSC_STRING] = ACTION_OSC_END;
+    // Kernel for printable runs
+    term_scan_init();
+
+    parser_table_ready = true;
+}
+
+/*!
+ * \brief Get CSI parameter with default value for omitted and zero ones
+ */
+static int parser_param(term_parser_t *parser, int index, int default_value) {
+    if (index >= parser->param_count || parser->params[index] == 0)
+        return default_value;
+    return parser->params[index];
+}
+
+/*!
+ * \brief Process C0 control character
+ */
+static void parser_execute(screen_t *screen, unsigned char c) {
+    switch (c) {
+        case '\r': /* CR */
+            screen->buffer_x = 0;
+            screen->wrap_pending = false;
+            break;
+        case '\t': /* HT */
+            screen->buffer_x = MIN((screen->buffer_x / TAB_SIZE + 1) * TAB_SIZE, screen->buffer_width - 1);
+            screen->wrap_pending = false;
+            break;
+        case '\b': /* BS */
+            // Reverse wrap lets canonical mode erase across wrapped line
+            if (screen->wrap_pending) {
+                screen->wrap_pending = false;
+            } else if (screen->buffer_x > 0) {
+                screen->buffer_x--;
+            } else if (screen->buffer_y > 0) {
+                screen->buffer_x = screen->buffer_width - 1;
+                screen->buffer_y--;
+            }
+            break;
+        case '\f': /* FF */
+        case '\v': /* VT */
+        case '\n': /* LF */
+            screen_line_feed(screen);
+            break;
+        default:
+            break;
+    }
+}
+
+/*!
+ * \brief Process ESC sequence with final character
+ */
+static void parser_esc_dispatch(screen_t *screen, term_parser_t *parser, unsigned char final) {
+    if (parser->intermediate_count)
+        return;
+    switch (final) {
+        case 'D': /* IND */
+            screen_line_feed(screen);
+            break;
+        case 'E': /* NEL */
+            screen->buffer_x = 0;
+            screen_line_feed(screen);
+            break;
+        case 'M': /* RI */
+            screen_reverse_line_feed(screen);
+            break;
+        case '7': /* DECSC */
+            screen_save_cursor(screen);
+            break;
+        case '8': /* DECRC */
+            screen_restore_cursor(screen);
+            break;
+        case 'c': /* RIS */
+            screen->pen = ATTR_DEFAULT;
+            screen_set_alternate(screen, false);
+            screen->saved[0].valid = false;
+            screen->saved[1].valid = false;
+            screen->scroll_top = 0;
+            screen->scroll_bottom = screen->buffer_height;
+            screen_clear(screen);
+            screen_cursor_home(screen);
+            screen->cursor_hidden = false;
+            screen->bracketed_paste = false;
+            break;
+        default:
+            break;
+    }
+}
+
+/*!
+ * \brief Process ED/EL erase sequences
+ */
+static void parser_erase(screen_t *screen, int mode, bool whole_display) {
+    int y = screen->buffer_y;
+    switch (mode) {
+        case 0: /* from cursor to end */
+            screen_erase(screen, y, screen->buffer_x, screen->buffer_width);
+            if (whole_display)
+                for (int i = y + 1; i < screen->buffer_height; i++)
+                    screen_erase(screen, i, 0, screen->buffer_width);
+            break;
+        case 1: /* from beginning to cursor */
+            screen_erase(screen, y, 0, screen->buffer_x + 1);
+            if (whole_display)
+                for (int i = 0; i < y; i++)
+                    screen_erase(screen, i, 0, screen->buffer_width);
+            break;
+        case 2: /* all */
+            if (whole_display)
+                screen_clear(screen);
+            else
+                screen_erase(screen, y, 0, screen->buffer_width);
+            break;
+        case 3: /* scrollback */
+            if (whole_display) {
+                history_clear(&screen->history);
+                screen->view_offset = 0;
+                screen->view_changed = true;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/*!
+ * \brief Count sub-parameters (separated by ':') that follow parameter
+ */
+static int parser_subparam_count(term_parser_t *parser, int index) {
+    int count = 0;
+    while (index + count + 1 < parser->param_count && (parser->subparams & (1u << (index + count + 1))))
+        count++;
+    return count;
+}
+
+/*!
+ * \brief Get color index of extended SGR color (38/48) starting at parameter *index, moves index to its last parameter
+ *  Both `38;5;n`, `38;2;r;g;b` and ITU T.416 forms `38:5:n`, `38:2:[colorspace]:r:g:b` are accepted
+ *  \return color index, -1 if color is malformed
+ */
+static int parser_sgr_color(screen_t *screen, term_parser_t *parser, int *index) {
+    int i = *index;
+    int subparams = parser_subparam_count(parser, i);
+    int first = i + 2;// first value after color kind
+    int last = 0;
+    int kind = (i + 1 < parser->param_count) ? parser->params[i + 1] : -1;
+    if (kind == 5) {
+        last = first;
+    } else if (kind == 2) {
+        if (subparams >= 5)
+            first++;// colorspace id is skipped
+        last = first + 2;
+    } else {
+        *index = i + subparams;
+        return -1;
+    }
+    *index = subparams ? i + subparams : last;
+    if (last >= parser->param_count)
+        return -1;
+    if (kind == 5)
+        return MIN(parser->params[first], COLOR_PALETTE_SIZE - 1);
+    return palette_truecolor(screen->palette,
+                             MIN(parser->params[first], 255),
+                             MIN(parser->params[first + 1], 255),
+                             MIN(parser->params[first + 2], 255));
+}
+
+/*!
+ * \brief Process SGR `ESC [ Pm m`, it changes pen of new characters
+ */
+static void parser_sgr(screen_t *screen, term_parser_t *parser) {
+    if (parser->param_count == 0) {
+        screen->pen = ATTR_DEFAULT;
+        return;
+    }
+    for (int i = 0; i < parser->param_count; i++) {
+        int p = parser->params[i];
+        int color = 0;
+        switch (p) {
+            case 0:
+                screen->pen = ATTR_DEFAULT;
+                break;
+            case 1:
+                screen->pen |= ATTR_BOLD;
+                break;
+            case 3:
+                screen->pen |= ATTR_ITALIC;
+                break;
+            case 4:
+                screen->pen |= ATTR_UNDERLINE;
+                break;
+            case 7:
+                screen->pen |= ATTR_REVERSE;
+                break;
+            case 8:
+                screen->pen |= ATTR_INVISIBLE;
+                break;
+            case 22:
+                screen->pen &= ~ATTR_BOLD;
+                break;
+            case 23:
+                screen->pen &= ~ATTR_ITALIC;
+                break;
+            case 24:
+                screen->pen &= ~ATTR_UNDERLINE;
+                break;
+            case 27:
+                screen->pen &= ~ATTR_REVERSE;
+                break;
+            case 28:
+                screen->pen &= ~ATTR_INVISIBLE;
+                break;
+            case 38:
+                if ((color = parser_sgr_color(screen, parser, &i)) >= 0)
+                    screen->pen = ATTR_SET_FG(screen->pen, color);
+                break;
+            case 39:
+                screen->pen = ATTR_SET_FG(screen->pen, COLOR_DEFAULT_FG);
+                break;
+            case 48:
+                if ((color = parser_sgr_color(screen, parser, &i)) >= 0)
+                    screen->pen = ATTR_SET_BG(screen->pen, color);
+                break;
+            case 49:
+                screen->pen = ATTR_SET_BG(screen->pen, COLOR_DEFAULT_BG);
+                break;
+            default:
+                if (p >= 30 && p <= 37)
+                    screen->pen = ATTR_SET_FG(screen->pen, p - 30);
+                else if (p >= 40 && p <= 47)
+                    screen->pen = ATTR_SET_BG(screen->pen, p - 40);
+                else if (p >= 90 && p <= 97)
+                    screen->pen = ATTR_SET_FG(screen->pen, p - 90 + 8);
+                else if (p >= 100 && p <= 107)
+                    screen->pen = ATTR_SET_BG(screen->pen, p - 100 + 8);
+                break;
+        }
+        // Unknown sub-parameters are skipped with their parameter
+        if (p != 38 && p != 48)
+            i += parser_subparam_count(parser, i);
+    }
+}
+
+/*!
+ * \brief Process DEC private modes `ESC [ ? Pm h/l`
+ */
+static void parser_set_private_mode(screen_t *screen, term_parser_t *parser, bool enable) {
+    for (int i = 0; i < parser->param_count; i++) {
+        switch (parser->params[i]) {
+            case 25: /* DECTCEM */
+                screen->cursor_hidden = !enable;
+                break;
+            case 2004: /* Bracketed paste */
+                screen->bracketed_paste = enable;
+                break;
+            case 47: /* Alternate screen */
+                screen_set_alternate(screen, enable);
+                break;
+            case 1047: /* Alternate screen cleared on leaving */
+                if (!enable && screen->alternate)
+                    screen_clear(screen);
+                screen_set_alternate(screen, enable);
+                break;
+            case 1049: /* Alternate screen cleared on entering, cursor is saved on the primary one */
+                if (enable) {
+                    screen_save_cursor(screen);
+                    screen_set_alternate(screen, true);
+                    if (screen->alternate)
+                        screen_clear(screen);
+                } else {
+                    screen_set_alternate(screen, false);
+                    screen_restore_cursor(screen);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/*!
+ * \brief Process CSI sequence with final character
+ */
+static void parser_csi_dispatch(screen_t *screen, term_parser_t *parser, unsigned char final) {
+    if (parser->intermediate_count == 1 && parser->intermediates[0] == '?') {
+        if (final == 'h' || final == 'l')
+            parser_set_private_mode(screen, parser, final == 'h');
+        return;
+    }
+    if (parser->intermediate_count)
+        return;
+    int n = parser_param(parser, 0, 1);
+    switch (final) {
+        case 'A': /* CUU */
+            screen_cursor_to(screen, screen->buffer_x, screen->buffer_y - n);
+            break;
+        case 'B': /* CUD */
+        case 'e': /* VPR */
+            screen_cursor_to(screen, screen->buffer_x, screen->buffer_y + n);
+            break;
+        case 'C': /* CUF */
+        case 'a': /* HPR */
+            screen_cursor_to(screen, screen->buffer_x + n, screen->buffer_y);
+            break;
+        case 'D': /* CUB */
+            screen_cursor_to(screen, screen->buffer_x - n, screen->buffer_y);
+            break;
+        case 'E': /* CNL */
+            screen_cursor_to(screen, 0, screen->buffer_y + n);
+            break;
+        case 'F': /* CPL */
+            screen_cursor_to(screen, 0, screen->buffer_y - n);
+            break;
+        case 'G': /* CHA */
+        case '`': /* HPA */
+            screen_cursor_to(screen, n - 1, screen->buffer_y);
+            break;
+        case 'd': /* VPA */
+            screen_cursor_to(screen, screen->buffer_x, n - 1);
+            break;
+        case 'H': /* CUP */
+        case 'f': /* HVP */
+            screen_cursor_to(screen, parser_param(parser, 1, 1) - 1, n - 1);
+            break;
+        case 'J': /* ED */
+            parser_erase(screen, parser_param(parser, 0, 0), true);
+            break;
+        case 'K': /* EL */
+            parser_erase(screen, parser_param(parser, 0, 0), false);
+            break;
+        case '@': /* ICH */
+            screen_insert_blanks(screen, n);
+            break;
+        case 'P': /* DCH */
+            screen_delete_chars(screen, n);
+            break;
+        case 'X': /* ECH */
+            screen_erase(screen, screen->buffer_y, screen->buffer_x, screen->buffer_x + n);
+            break;
+        case 'S': /* SU */
+            for (int i = 0; i < MIN(n, screen->buffer_height); i++)
+                screen_scroll_up(screen);
+            break;
+        case 'T': /* SD */
+            for (int i = 0; i < MIN(n, screen->buffer_height); i++)
+                screen_scroll_down(screen);
+            break;
+        case 'L': /* IL */
+            screen_insert_lines(screen, n);
+            break;
+        case 'M': /* DL */
+            screen_delete_lines(screen, n);
+            break;
+        case 'r': /* DECSTBM */
+            screen_set_region(screen, n - 1, parser_param(parser, 1, screen->buffer_height));
+            break;
+        case 's': /* SCOSC */
+            screen_save_cursor(screen);
+            break;
+        case 'u': /* SCORC */
+            screen_restore_cursor(screen);
+            break;
+        case 'm': /* SGR */
+            parser_sgr(screen, parser);
+            break;
+        case 'c': /* DA */
+            screen_answer(screen, "\033[?6c", 5);
+            break;
+        case 'n': /* DSR */
+            if (parser_param(parser, 0, 0) == 5) {
+                screen_answer(screen, "\033[0n", 4);
+            } else if (parser_param(parser, 0, 0) == 6) {
+                char report[32] = {};
+                int length = snprintf(report, sizeof(report), "\033[%d;%dR", screen->buffer_y + 1, screen->buffer_x + 1);
+                screen_answer(screen, report, length);
+            }
+            break;
+        default: /* modes are not supported yet */
+            break;
+    }
+}
+
+/*!
+ * \brief Process OSC string when it is terminated
+ *  Note: only window title `ESC ] 0/2 ; title ST` is supported
+ */
+static void parser_osc_dispatch(screen_t *screen, term_parser_t *parser) {
+    parser->osc[parser->osc_length] = '\0';
+    char *text = strchr(parser->osc, ';');
+    if (!text)
+        return;
+    int command = atoi(parser->osc);
+    if (command == 0 || command == 2) {
+        strcpy(screen->title, text + 1);
+        screen->title_changed = true;
+    }
+}
+
+/*!
+ * \brief Feed text byte to UTF-8 decoder and put completed characters
+ */
+static void parser_print(screen_t *screen, term_parser_t *parser, unsigned char c) {
+    uint32_t codepoint = 0;
+    utf8_result_t result = utf8_decode(&parser->utf8, c, &codepoint);
+    if (result == UTF8_INCOMPLETE)
+        return;
+    screen_put_char(screen, codepoint);
+    if (result == UTF8_RETRY && utf8_decode(&parser->utf8, c, &codepoint) == UTF8_DONE)
+        screen_put_char(screen, codepoint);
+}
+
+/*!
+ * \brief Perform parser action with byte
+ */
+static void parser_do_action(screen_t *screen, term_parser_t *parser, parser_action_t action, unsigned char c) {
+    switch (action) {
+        case ACTION_PRINT:
+            parser_print(screen, parser, c);
+            break;
+        case ACTION_EXECUTE:
+            parser_execute(screen, c);
+            break;
+        case ACTION_CLEAR:
+            parser->param_count = 0;
+            parser->subparams = 0;
+            parser->intermediate_count = 0;
+            parser->overflow = false;
+            break;
+        case ACTION_COLLECT:
+            if (parser->intermediate_count < PARSER_MAX_INTERMEDIATES)
+                parser->intermediates[parser->intermediate_count++] = (char) c;
+            else
+                parser->overflow = true;
+            break;
+        case ACTION_PARAM:
+            if (parser->param_count == 0) {
+                parser->params[0] = 0;
+                parser->param_count = 1;
+            }
+            if (c == ';' || c == ':') {
+                if (parser->param_count < PARSER_MAX_PARAMS) {
+                    if (c == ':')
+                        parser->subparams |= 1u << parser->param_count;
+                    parser->params[parser->param_count++] = 0;
+                } else {
+                    parser->overflow = true;
+                }
+            } else {
+                int *param = &parser->params[parser->param_count - 1];
+                if (*param < 100000)
+                    *param = *param * 10 + (c - '0');
+            }
+            break;
+        case ACTION_ESC_DISPATCH:
+            if (!parser->overflow)
+                parser_esc_dispatch(screen, parser, c);
+            break;
+        case ACTION_CSI_DISPATCH:
+            if (!parser->overflow)
+                parser_csi_dispatch(screen, parser, c);
+            break;
+        case ACTION_OSC_START:
+            parser->osc_length = 0;
+            break;
+        case ACTION_OSC_PUT:
+            if (parser->osc_length < PARSER_MAX_OSC - 1)
+                parser->osc[parser->osc_length++] = (char) c;
+            break;
+        case ACTION_OSC_END:
+            parser_osc_dispatch(screen, parser);
+            break;
+        default:
+            break;
+    }
+}
+
+/*!
+ * \brief Process data from PTY and changes buffer
+ *  Plain text in ground state is consumed as whole runs found by SIMD kernel and UTF-8 text is decoded in place,
+ *  other bytes go through the state table.
+ *  State is kept in `screen->parser`, so sequences split between reads are handled.
+ */
+void screen_output(screen_t *screen, const char *buf, size_t n) {
+    term_parser_t *parser = &screen->parser;
+    const unsigned char *p = (const unsigned char *) buf;
+    const unsigned char *end = p + n;
+    while (p < end) {
+        // Fast path for printable run
+        if (parser->state == STATE_GROUND && IS_PRINTABLE_ASCII(*p) && !parser->utf8.remaining) {
+            size_t run = term_scan_printable(p, (size_t) (end - p));
+            screen_put_run(screen, (const char *) p, run);
+            p += run;
+            continue;
+        }
+        // Non-ASCII text
+        if (parser->state == STATE_GROUND && *p >= 0x80) {
+            while (p < end && *p >= 0x80)
+                parser_print(screen, parser, *p++);
+            continue;
+        }
+        parser_transition_t transition = parser_table[parser->state][*p];
+        // Control interrupting UTF-8 sequence ends it
+        if (parser->utf8.remaining && transition.action != ACTION_PRINT) {
+            parser->utf8.remaining = 0;
+            screen_put_char(screen, UTF8_REPLACEMENT);
+        }
+        if (transition.state == STATE_KEEP) {
+            parser_do_action(screen, parser, transition.action, *p);
+        } else {
+            parser_do_action(screen, parser, parser_exit_action[parser->state], *p);
+            parser_do_action(screen, parser, transition.action, *p);
+            parser->state = transition.state;
+            parser_do_action(screen, parser, parser_entry_action[parser->state], *p);
+        }
+        p++;
+    }
+}
@@ -1,16 +1,40 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <pty.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include <X11/Xatom.h>
 #include <X11/Xutil.h>
+#include <X11/keysym.h>
 
 #include "main.h"
+#include "term_color.h"
+#include "term_history.h"
+#include "term_utf8.h"
+#include "term_parser.h"
+#include "term_select.h"
+#include "term_screen.h"
+#include "term_ring.h"
+#include "term_record.h"
+#include "term_loop.h"
+#include "term_stats.h"
 #include "term.h"
 #include "term_pty.h"
+#include "util.h"
 
 /*!
  * \brief Creates PTY pair and forking shell
@@ -39,8 +63,18 @@ bool pty_new(pty_t *pty) {
      * Create new process for shell
      */
     pty->pid = fork();
+    if (pty->pid == -1) {
+        perror("fork");
+        close(pty->fd_master);
+        close(pty->fd_slave);
+        return false;
+    }
     if (pty->pid == 0) {
         close(pty->fd_master);
+        // SIGUSR1 is blocked for signalfd of statistics, shell must get default mask
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
 
         /* 
          * Create a new session and make our terminal this process'
@@ -49,14 +83,14 @@ bool pty_new(pty_t *pty) {
         setsid();
         if (ioctl(pty->fd_slave, TIOCSCTTY, NULL) == -1) {
             perror("ioctl(TIOCSCTTY)");
-            return false;
+            _exit(1);
         }
 
         // Set termios mode to configure reading bytes from pty slave:
         struct termios tios;
         if (tcgetattr(pty->fd_slave, &tios) == -1) {
             perror("tcgetattr");
-            return false;
+            _exit(1);
         }
         tios.c_lflag |= ICANON | ECHO;
         tios.c_oflag |= OPOST | ONLCR;// ONLCR: convert \n в \r\n when reading
@@ -72,7 +106,7 @@ bool pty_new(pty_t *pty) {
 #endif
         if (tcsetattr(pty->fd_slave, TCSANOW, &tios) == -1) {
             perror("tcsetattr");
-            return false;
+            _exit(1);
         }
 
         //* Close master fd, and change stdout, stdin, stderr to slave fd!
@@ -88,43 +122,164 @@ bool pty_new(pty_t *pty) {
             pty->shell_name = SHELL_NAME;
         }
         execl(pty->shell_path, pty->shell_name, NULL);
-        return false;
+        // Child must never return into the loop of the parent
+        perror("execl");
+        _exit(1);
     }
     close(pty->fd_slave);
+    // Master is drained until EAGAIN, so it must not block
+    int flags = fcntl(pty->fd_master, F_GETFL);
+    if (flags == -1 || fcntl(pty->fd_master, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl(O_NONBLOCK)");
+        return false;
+    }
+    pty->read_capacity = READ_BUFFER_SIZE;
+    pty->read_buffer = malloc(pty->read_capacity);
+    if (!pty->read_buffer) {
+        perror("malloc");
+        return false;
+    }
+    if (pty->threaded)
+        return pty_start_reader(pty);
+    return true;
+}
+
+/*!
+ * \brief Add one to eventfd counter, waking up its poller
+ */
+static void pty_signal(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        perror("write(eventfd)");
+}
+
+/*!
+ * \brief Reset eventfd counter
+ */
+static void pty_clear(int fd) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        perror("read(eventfd)");
+}
+
+/*!
+ * \brief Reader thread: drain PTY into ring while UI thread is busy with X server
+ *  When ring is full the shell is paused by the kernel until UI thread parses the backlog.
+ */
+static void *pty_reader(void *arg) {
+    pty_t *pty = arg;
+    struct pollfd fds[2] = {
+        {.fd = pty->fd_wake, .events = POLLIN},
+        {.fd = pty->fd_master, .events = POLLIN},
+    };
+    while (!atomic_load(&pty->reader_stop)) {
+        char *span;
+        size_t space = ring_write_span(&pty->ring, &span);
+        if (space == 0) {
+            // Flag is set before the check, so consumer freeing space after it always wakes us
+            atomic_store(&pty->reader_waiting, true);
+            if (ring_write_span(&pty->ring, &span) == 0 && poll(fds, 1, -1) > 0)
+                pty_clear(pty->fd_wake);
+            atomic_store(&pty->reader_waiting, false);
+            continue;
+        }
+        ssize_t count = read(pty->fd_master, span, space);
+        if (count > 0) {
+            ring_commit(&pty->ring, (size_t) count);
+            pty_signal(pty->fd_ready);
+            continue;
+        }
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1 && errno == EAGAIN) {
+            if (poll(fds, 2, -1) > 0 && (fds[0].revents & POLLIN))
+                pty_clear(pty->fd_wake);
+            continue;
+        }
+        // EOF or EIO indicates that the slave has closed.
+        break;
+    }
+    atomic_store(&pty->reader_closed, true);
+    pty_signal(pty->fd_ready);
+    return NULL;
+}
+
+/*!
+ * \brief Start thread that drains PTY into ring, `run` then waits for `fd_ready` instead of PTY master
+ */
+bool pty_start_reader(pty_t *pty) {
+    if (!ring_init(&pty->ring, READ_BUFFER_MAX))
+        return false;
+    pty->fd_ready = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pty->fd_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pty->fd_ready == -1 || pty->fd_wake == -1) {
+        perror("eventfd");
+        return false;
+    }
+    atomic_init(&pty->reader_waiting, false);
+    atomic_init(&pty->reader_stop, false);
+    atomic_init(&pty->reader_closed, false);
+    int error = pthread_create(&pty->reader, NULL, pty_reader, pty);
+    if (error) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return false;
+    }
     return true;
 }
 
 /*!
- * \brief Change sizes of terminal's window
+ * \brief Stop reader thread and free its ring
  */
-bool term_resize(term_t *term, pty_t *pty, XEvent *event) {
+void pty_stop_reader(pty_t *pty) {
+    atomic_store(&pty->reader_stop, true);
+    pty_signal(pty->fd_wake);
+    pthread_join(pty->reader, NULL);
+    close(pty->fd_ready);
+    close(pty->fd_wake);
+    ring_destroy(&pty->ring);
+}
+
+/*!
+ * \brief Close PTY of session, shell gets SIGHUP and is reaped if it has already exited
+ */
+void pty_destroy(pty_t *pty) {
+    if (pty->threaded)
+        pty_stop_reader(pty);
+    close(pty->fd_master);
+    free(pty->read_buffer);
+    pty->read_buffer = NULL;
+    free(pty->write_buffer);
+    pty->write_buffer = NULL;
+    pty->write_offset = pty->write_length = pty->write_capacity = 0;
+    waitpid(pty->pid, NULL, WNOHANG);
+}
+
+/*!
+ * \brief Change sizes of terminal's window, returns true if they changed and screens must follow
+ */
+bool term_resize(term_t *term, XEvent *event) {
     int new_width = (int) event->xconfigure.width;
     int new_height = (int) event->xconfigure.height;
     if (new_width == term->width && new_height == term->height)
         return false;
-    int new_buffer_width = new_width / term->font_width;
-    int new_buffer_height = new_height / term->font_height;
-    term_move_buffer(term, new_buffer_width, new_buffer_height);
     term->width = new_width;
     term->height = new_height;
-    if (!pty_resize(term, pty))
-        return false;
-    XClearWindow(term->display, term->window);
+    term_set_back_buffer(term);
     return true;
 }
 
 /*!
  * \brief Send size of terminal to driver
  */
-bool pty_resize(term_t *term, pty_t *pty) {
+bool pty_resize(pty_t *pty, int width, int height) {
     /* 
      * Create system struct with sizes of our window
      * This is the very same ioctl that normal programs use to query the
      * window size.
      */
     struct winsize ws = {
-        .ws_col = (unsigned short int) term->buffer_width,
-        .ws_row = (unsigned short int) term->buffer_height,
+        .ws_col = (unsigned short int) width,
+        .ws_row = (unsigned short int) height,
     };
     if (ioctl(pty->fd_master, TIOCSWINSZ, &ws) == -1) {
         perror("ioctl(TIOCSWINSZ)");
@@ -134,145 +289,1175 @@ bool pty_resize(term_t *term, pty_t *pty) {
 }
 
 /*!
- * \brief Writes new key data to PTY from terminal
+ * \brief Handle Shift+PgUp/PgDn scrolling through history, returns true if key was consumed
+ */
+bool term_scroll_key(term_t *term, XKeyEvent *ev) {
+    KeySym ksym = XLookupKeysym(ev, 0);
+    if ((ev->state & ShiftMask) && (ksym == XK_Prior || ksym == XK_Next)) {
+        int page = MAX(term->model->buffer_height / 2, 1);
+        screen_scroll_view(term->model, (ksym == XK_Prior) ? page : -page);
+        return true;
+    }
+    // Typing returns view to the screen
+    if (term->model->view_offset > 0 && !IsModifierKey(ksym))
+        screen_scroll_view(term->model, -(int) term->model->view_offset);
+    return false;
+}
+
+/*!
+ * \brief Append bytes to input queue of PTY, they are written by `pty_flush`
+ */
+bool pty_queue(pty_t *pty, const char *data, size_t n) {
+    if (pty->write_offset > 0 && pty->write_length + n > pty->write_capacity) {
+        // Written part is dropped before growing
+        memmove(pty->write_buffer, pty->write_buffer + pty->write_offset, pty->write_length - pty->write_offset);
+        pty->write_length -= pty->write_offset;
+        pty->write_offset = 0;
+    }
+    if (pty->write_length + n > pty->write_capacity) {
+        size_t capacity = pty->write_capacity ? pty->write_capacity : READ_BUFFER_SIZE;
+        while (capacity < pty->write_length + n)
+            capacity *= 2;
+        char *new_write_buffer = realloc(pty->write_buffer, capacity);
+        if (!new_write_buffer) {
+            perror("realloc");
+            return false;
+        }
+        pty->write_buffer = new_write_buffer;
+        pty->write_capacity = capacity;
+    }
+    memcpy(pty->write_buffer + pty->write_length, data, n);
+    pty->write_length += n;
+    return true;
+}
+
+/*!
+ * \brief Write input queue to PTY until it's full, returns true when queue is empty
+ *  Master is non-blocking, so big paste never freezes the window: the rest waits for EPOLLOUT.
+ */
+bool pty_flush(pty_t *pty) {
+    while (pty->write_offset < pty->write_length) {
+        ssize_t count = write(pty->fd_master, pty->write_buffer + pty->write_offset, pty->write_length - pty->write_offset);
+        if (count > 0) {
+            pty->write_offset += (size_t) count;
+            continue;
+        }
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1 && errno == EAGAIN)
+            return false;
+        // Shell is gone, session is closed by reading side
+        perror("write");
+        break;
+    }
+    pty->write_offset = 0;
+    pty->write_length = 0;
+    if (pty->write_capacity > WRITE_BUFFER_KEEP) {
+        free(pty->write_buffer);
+        pty->write_buffer = NULL;
+        pty->write_capacity = 0;
+    }
+    return true;
+}
+
+/*!
+ * \brief Queue key for PTY, keys of one batch of X events are written at once
  */
 void term_pty_write(pty_t *pty, XKeyEvent *ev) {
     char buf[32] = {};
     KeySym ksym = 0;
     size_t num = (size_t) XLookupString(ev, buf, sizeof(buf), &ksym, 0);
+    if (num == 0)
+        return;
+    if (pty->stats)
+        stats_key(pty->stats, pty);
+    pty_queue(pty, buf, num);
+}
 
-    //printf("Write:\n");
-    //for (int i = 0; i < num; i++) {
-    //    printf("%d ", buf[i]);
-    //}
-    //printf("N: %d\n", num);
-
-    if (num > 0) {
-        if (write(pty->fd_master, buf, num) == -1) {
-            perror("write");
-            return;
-        }
+/*!
+ * \brief Queue replies to status requests collected by parser, they follow queued keys and paste
+ */
+static void term_pty_answer(screen_t *screen, pty_t *pty) {
+    if (screen->answer_length > 0) {
+        pty_queue(pty, screen->answer, (size_t) screen->answer_length);
+        screen->answer_length = 0;
     }
 }
 
 /*!
- * \brief Read from PTY new data and draw it on the screen 
+ * \brief Parse everything reader thread has put into ring, returns false when PTY is closed and ring is drained
  */
-bool term_pty_read(term_t *term, pty_t *pty) {
-    char buf_read[READ_BUFFER_SIZE];
-    ssize_t n = read(pty->fd_master, buf_read, sizeof(buf_read));
-
-    // EOF indicates that the slave has closed.
-    if (n <= 0) {
-        return false;
+static bool term_ring_read(screen_t *screen, pty_t *pty) {
+    pty_clear(pty->fd_ready);
+    // Closed flag is read first, so bytes committed before it are all seen below
+    bool closed = atomic_load(&pty->reader_closed);
+    // At most one ring of output per call, so X events aren't starved while reader keeps up with the shell
+    size_t budget = pty->ring.capacity;
+    uint64_t parse_begin = pty->stats ? stats_now() : 0;
+    const char *span;
+    size_t n;
+    while (budget > 0 && (n = ring_read_span(&pty->ring, &span)) > 0) {
+        n = MIN(n, budget);
+        if (pty->record)
+            record_output(pty->record, span, n);
+        screen_output(screen, span, n);
+        ring_consume(&pty->ring, n);
+        budget -= n;
+        if (atomic_load(&pty->reader_waiting))
+            pty_signal(pty->fd_wake);
     }
-    if (n > 0) {
-        term_output(term, buf_read, n);
-    }
-    char buf[1] = {};
-    XSetForeground(term->display, term->graphics_context, term->color_fg);
-    for (int y = 0; y < term->buffer_height; y++) {
-        for (int x = 0; x < term->buffer_width; x++) {
-            buf[0] = term->buffer[y * term->buffer_width + x];
-            // Filter non-printables
-            if (!IS_PRINTABLE_ASCII(buf[0]) /*&& !IS_PRINTABLE_UNICODE(buf[0])*/) {
-                continue;// Unicode replacement character <unknown>
+    // Reads of reader thread are merged, so its bytes are counted per wake of UI thread
+    if (pty->stats && budget < pty->ring.capacity)
+        stats_output(pty->stats, pty, pty->ring.capacity - budget, stats_now() - parse_begin);
+    pty->read_more = !ring_empty(&pty->ring);
+    if (pty->read_more)
+        return true;
+    term_pty_answer(screen, pty);
+    return !closed;
+}
+
+/*!
+ * \brief Drain all available data from PTY and process it into the buffer, drawing is left to `term_draw`
+ *  Read buffer grows while the shell floods output, so one parse pass covers many reads
+ */
+bool term_pty_read(screen_t *screen, pty_t *pty) {
+    if (pty->threaded)
+        return term_ring_read(screen, pty);
+    size_t n = 0;
+    bool alive = true;
+    pty->read_more = false;
+    while (true) {
+        if (n == pty->read_capacity) {
+            if (pty->read_capacity >= READ_BUFFER_MAX) {
+                pty->read_more = true;
+                break;
             }
-            XDrawString(term->display,
-                        term->window,
-                        term->graphics_context,
-                        (int) (x * term->font_width),
-                        (int) (y * term->font_height) + term->font->ascent + term->font->descent,
-                        buf,
-                        1);
+            char *new_read_buffer = realloc(pty->read_buffer, pty->read_capacity * 2);
+            if (!new_read_buffer) {
+                pty->read_more = true;
+                break;
+            }
+            pty->read_buffer = new_read_buffer;
+            pty->read_capacity *= 2;
+        }
+        ssize_t count = read(pty->fd_master, pty->read_buffer + n, pty->read_capacity - n);
+        if (count > 0) {
+            n += (size_t) count;
+            continue;
         }
+        if (count == -1 && errno == EINTR)
+            continue;
+        // EOF or EIO indicates that the slave has closed.
+        if (count == 0 || errno != EAGAIN)
+            alive = false;
+        break;
     }
-    return true;
+    if (n > 0) {
+        if (pty->record)
+            record_output(pty->record, pty->read_buffer, n);
+        uint64_t parse_begin = pty->stats ? stats_now() : 0;
+        screen_output(screen, pty->read_buffer, n);
+        if (pty->stats)
+            stats_output(pty->stats, pty, n, stats_now() - parse_begin);
+    }
+    term_pty_answer(screen, pty);
+    return alive;
+}
+
+/*!
+ * \brief Print rendering statistics and latency histograms to stderr
+ */
+static void term_print_stats(term_t *term) {
+    fprintf(stderr,
+            "Frames drawn: %lu, X requests: %lu (%.1f per frame)\n",
+            term->stats_frames,
+            term->stats_requests,
+            term->stats_frames ? (double) term->stats_requests / (double) term->stats_frames : 0.0);
+    stats_print(&term->stats, stderr);
 }
 
 /*!
  * \brief Destroys terminal
  */
-bool term_destroy(term_t *term, pty_t *pty) {
+bool term_destroy(term_t *term) {
+    if (term->print_stats)
+        term_print_stats(term);
     // Cleanup resources
     XFreeGC(term->display, term->graphics_context);
+    XFreePixmap(term->display, term->back_buffer);
     XFreeFont(term->display, term->font);
     XUnmapWindow(term->display, term->window);
     XDestroyWindow(term->display, term->window);
     XCloseDisplay(term->display);
-    free(term->buffer);
+    free(term->glyph_cache);
+    free(term->draw_line);
+    free(term->draw_line16);
+    free(term->view_chars);
+    free(term->view_attrs);
     return true;
 }
 
 /*!
  * \brief Catch error with destroying
  */
-void term_catch_error(term_t *term, pty_t *pty) {
-    term_destroy(term, pty);
+void term_catch_error(term_t *term) {
+    term_destroy(term);
     exit(1);
 }
 
 /*!
- * \brief Main loop of terminal & pty life
+ * @struct run_session_t
+ * @brief Shell with its PTY and screen, sessions share window, font, colors and glyph cache of terminal
  */
-bool run(term_t *term, pty_t *pty) {
-    // Store event from X11 terminal
-    XEvent event = {};
-    // Create fd set
-    int fd_max = pty->fd_master > term->fd ? pty->fd_master : term->fd;// count range of fd to read
-    fd_set readable = {};
-    bool running = true;
-    while (running) {
-        // Waiting for I/O with `select` syscall and <sys/select.h>
-        FD_ZERO(&readable);// Clearing all file descriptors from the set
-        // Add the file descriptors for reading to fd set
-        FD_SET(pty->fd_master, &readable);
-        FD_SET(term->fd, &readable);
-        // Waits for I/O across multiple FDs without polling
-        if (select(fd_max + 1, &readable, NULL, NULL, NULL) == -1) {
-            perror("select");
+typedef struct run_session_t {
+    struct run_state_t *state;  ///< Main loop state
+    pty_t *pty;                 ///< PTY of shell
+    screen_t *screen;           ///< Screen shell writes to
+    loop_source_t *source;      ///< Source of shell output (PTY master or reader thread eventfd)
+    loop_source_t *source_input;///< Source of PTY master waiting for space in threaded mode
+    bool input_watched;         ///< PTY is watched for space, input is queued
+    bool owned;                 ///< PTY and screen are allocated by session
+} run_session_t;
+
+/*!
+ * @struct run_state_t
+ * @brief State shared by handlers of the main loop
+ */
+typedef struct run_state_t {
+    term_t *term;                        ///< Terminal
+    pty_t *options;                      ///< PTY with shell options from command line, new sessions copy them
+    term_loop_t loop;                    ///< Event loop
+    loop_source_t *source_x;             ///< Source of X connection
+    run_session_t *sessions[SESSION_MAX];///< Sessions in order of tabs
+    int session_count;                   ///< Number of sessions
+    int active;                          ///< Index of session shown in window
+    bool title_changed;                  ///< Tab was switched, title must be stored again
+    int fd_frame;                        ///< One-shot timer of postponed frame
+    int fd_blink;                        ///< Periodic timer of cursor blink
+    int fd_resize;                       ///< One-shot timer of postponed reflow after window resize
+    int fd_signal;                       ///< Signalfd of SIGUSR1 printing statistics, -1 without `--stats`
+    unsigned long frame_last;            ///< Time of the last frame
+    bool frame_pending;                  ///< Frame timer is armed
+    bool blink_armed;                    ///< Blink timer is armed
+    unsigned long active_last;           ///< Time of the last input or output, blinking stops when it's old
+    term_record_t record;                ///< Log output of the first session is recorded to
+    bool recording;                      ///< Log is open
+    term_replay_t replay;                ///< Log replayed instead of shell
+    bool replaying;                      ///< Window shows replay, there are no sessions
+    record_type_t replay_type;           ///< Type of read record waiting for its time
+    int fd_replay;                       ///< One-shot timer of the next replayed record
+    loop_source_t *source_replay;        ///< Source of replay timer
+    unsigned long replay_start;          ///< Time replay started
+    run_session_t *paste_session;        ///< Session selection is pasted into, NULL if no paste is requested
+    bool paste_incr;                     ///< Selection comes in parts (INCR), each PropertyNotify brings one
+    bool paste_bracketed;                ///< Paste is wrapped in bracketed paste markers
+    char *copy_text[2];                  ///< Text window owns PRIMARY and CLIPBOARD with, NULL if it doesn't own one
+    size_t copy_length[2];               ///< Length of owned text
+    bool selecting;                      ///< Button 1 is held, motion extends selection
+    Time click_time;                     ///< Time of the last click of button 1
+    int click_count;                     ///< Clicks in a row: one selects cells, two words, three lines
+    int click_x, click_y;                ///< Cell of the last click
+    size_t search_shown;                 ///< Number of matches shown in title
+} run_state_t;
+
+/*!
+ * \brief Store title of active session in window: tab number, title set by shell and state of search
+ */
+static void run_title(run_state_t *state, size_t search_found) {
+    term_t *term = state->term;
+    screen_t *screen = term->model;
+    const char *title = screen->title[0] ? screen->title : TERM_NAME;
+    char tab_title[PARSER_MAX_OSC + 4 * SEARCH_MAX + 64];
+    int length = 0;
+    if (state->session_count > 1)
+        length = snprintf(tab_title, sizeof(tab_title), "[%d/%d] %s", state->active + 1, state->session_count, title);
+    else
+        length = snprintf(tab_title, sizeof(tab_title), "%s", title);
+    if (screen->search.active) {
+        char query[4 * SEARCH_MAX + 1];
+        int query_length = 0;
+        for (int i = 0; i < screen->search.length; i++)
+            if (screen->search.query[i] != CELL_WIDE_TAIL)
+                query_length += utf8_encode(screen->search.query[i], query + query_length);
+        query[query_length] = '\0';
+        snprintf(tab_title + length, sizeof(tab_title) - (size_t) length, " [search: %s, %zu found]", query, search_found);
+    }
+    XStoreName(term->display, term->window, tab_title);
+    screen->title_changed = false;
+    state->title_changed = false;
+    state->search_shown = search_found;
+}
+
+/*!
+ * \brief Draw frame, events Xlib read from socket while flushing are dispatched without waiting
+ */
+static void run_draw(run_state_t *state) {
+    term_t *term = state->term;
+    // Matches of new output are counted as it comes, only its lines are scanned
+    size_t search_found = term->model->search.active ? search_count(term->model) : 0;
+    if (term->model->title_changed || state->title_changed || search_found != state->search_shown)
+        run_title(state, search_found);
+    term_draw(term);
+    state->frame_last = time_now_us();
+    if (XQLength(state->term->display) > 0)
+        loop_defer(&state->loop, state->source_x);
+}
+
+/*!
+ * \brief Show cursor and restart blinking after input or output
+ */
+static void run_activity(run_state_t *state) {
+    state->active_last = time_now_us();
+    state->term->cursor_blink_off = false;
+    if (!state->blink_armed && state->term->blink_rate > 0) {
+        unsigned long interval = (unsigned long) state->term->blink_rate * 1000UL;
+        state->blink_armed = loop_timer_set(state->fd_blink, interval, interval);
+    }
+}
+
+/*!
+ * \brief Draw frame after output now or postpone it to frame timer
+ */
+static void run_request_frame(run_state_t *state) {
+    if (state->frame_pending)
+        return;
+    unsigned long elapsed = time_now_us() - state->frame_last;
+    if (elapsed >= state->term->frame_interval)
+        run_draw(state);
+    else
+        state->frame_pending = loop_timer_set(state->fd_frame, state->term->frame_interval - elapsed, 0);
+}
+
+static void run_output(term_loop_t *loop, void *data, uint32_t events);
+static void run_input(term_loop_t *loop, void *data, uint32_t events);
+
+/*!
+ * \brief Write queued input of session, PTY is watched for space while something is left
+ *  Direct PTY source gets EPOLLOUT added, in threaded mode master isn't in the loop, so it's added for that time.
+ */
+static void run_input_flush(run_state_t *state, run_session_t *session) {
+    bool watch = !pty_flush(session->pty);
+    if (watch == session->input_watched)
+        return;
+    if (!session->pty->threaded) {
+        loop_modify(&state->loop, session->source, EPOLLIN | EPOLLET | (watch ? EPOLLOUT : 0));
+    } else if (watch) {
+        session->source_input = loop_add(&state->loop, session->pty->fd_master, EPOLLOUT, run_input, session);
+        watch = session->source_input != NULL;
+    } else {
+        loop_remove(&state->loop, session->source_input);
+        session->source_input = NULL;
+    }
+    session->input_watched = watch;
+}
+
+/*!
+ * \brief Show session in window, it's repainted whole
+ */
+static void run_switch(run_state_t *state, int index) {
+    state->active = index;
+    state->term->model = state->sessions[index]->screen;
+    screen_damage_all(state->term->model);
+    state->title_changed = true;
+    run_draw(state);
+}
+
+/*!
+ * \brief Free session, its PTY and screen
+ */
+static void run_session_free(run_session_t *session) {
+    if (session->owned) {
+        free(session->pty);
+        free(session->screen);
+    }
+    free(session);
+}
+
+/*!
+ * \brief Start shell in new session, storage of PTY and screen is allocated if it's not given
+ */
+static bool run_session_open(run_state_t *state, pty_t *pty, screen_t *screen) {
+    term_t *term = state->term;
+    if (state->session_count == SESSION_MAX)
+        return false;
+    run_session_t *session = calloc(1, sizeof(run_session_t));
+    if (!session) {
+        perror("calloc");
+        return false;
+    }
+    *session = (run_session_t) {.state = state, .pty = pty, .screen = screen};
+    if (!pty) {
+        session->owned = true;
+        session->pty = calloc(1, sizeof(pty_t));
+        session->screen = calloc(1, sizeof(screen_t));
+        if (!session->pty || !session->screen) {
+            perror("calloc");
+            run_session_free(session);
+            return false;
+        }
+        session->pty->shell_path = state->options->shell_path;
+        session->pty->shell_name = state->options->shell_name;
+        session->pty->threaded = state->options->threaded;
+        session->pty->stats = state->options->stats;
+        // New screen has size of the window
+        screen_t *active = term->model;
+        if (!screen_init(session->screen,
+                         &term->palette,
+                         active->buffer_width,
+                         active->buffer_height,
+                         (size_t) term->history_size * 1024)) {
+            run_session_free(session);
             return false;
         }
-        // Check which fd has activity
-        // Terminal activity
-        if (FD_ISSET(term->fd, &readable)) {
-            while (XPending(term->display)) {
-                XNextEvent(term->display, &event);
-                if (XFilterEvent(&event, None))
-                    continue;
-                switch (event.type) {
-                    case ClientMessage:
-                        if (event.xclient.message_type == XInternAtom(term->display, "WM_PROTOCOLS", True) &&
-                            event.xclient.data.l[0] == (unsigned int) term->wm_delete) {
-                            running = false;
-                        }
-                        break;
-                    case DestroyNotify:
-                        // Window destroyed externally
-                        running = false;
-                        break;
-                    case ConfigureNotify:
-                        term_resize(term, pty, &event);
-                        break;
-                    // Redraw the terminal content
-                    case Expose:
-                        term_draw(term);
-                        break;
-                    // Pass new key to shell
-                    case KeyPress:
-                        term_pty_write(pty, &event.xkey);
-                        break;
-                    default:
-                        break;
+    }
+    if (!pty_new(session->pty)) {
+        if (session->owned)
+            screen_destroy(session->screen);
+        run_session_free(session);
+        return false;
+    }
+    pty_resize(session->pty, session->screen->buffer_width, session->screen->buffer_height);
+    int fd_output = session->pty->threaded ? session->pty->fd_ready : session->pty->fd_master;
+    session->source = loop_add(&state->loop, fd_output, EPOLLIN | EPOLLET, run_output, session);
+    if (!session->source) {
+        pty_destroy(session->pty);
+        if (session->owned)
+            screen_destroy(session->screen);
+        run_session_free(session);
+        return false;
+    }
+    state->sessions[state->session_count++] = session;
+    state->title_changed = true;
+    return true;
+}
+
+/*!
+ * \brief Close session after its shell has exited, loop stops with the last one
+ */
+static void run_session_close(run_state_t *state, run_session_t *session) {
+    int index = 0;
+    while (state->sessions[index] != session)
+        index++;
+    loop_remove(&state->loop, session->source);
+    if (session->source_input)
+        loop_remove(&state->loop, session->source_input);
+    // Rest of INCR transfer is read and dropped
+    if (state->paste_session == session)
+        state->paste_session = NULL;
+    pty_destroy(session->pty);
+    screen_destroy(session->screen);
+    run_session_free(session);
+    state->session_count--;
+    for (int i = index; i < state->session_count; i++)
+        state->sessions[i] = state->sessions[i + 1];
+    if (state->session_count == 0) {
+        state->loop.running = false;
+        return;
+    }
+    state->title_changed = true;
+    if (index < state->active)
+        state->active--;
+    else if (index == state->active) {
+        state->active = MIN(index, state->session_count - 1);
+        // Nothing is drawn while sessions are closed at exit
+        if (state->loop.running)
+            run_switch(state, state->active);
+    }
+}
+
+/*!
+ * \brief Handle Ctrl+Shift+T (new tab) and Ctrl+PgUp/PgDn (previous/next tab), returns true if key was consumed
+ */
+static bool run_tab_key(run_state_t *state, XKeyEvent *ev) {
+    if (!(ev->state & ControlMask) || state->replaying)
+        return false;
+    KeySym ksym = XLookupKeysym(ev, 0);
+    if ((ev->state & ShiftMask) && ksym == XK_t) {
+        if (run_session_open(state, NULL, NULL))
+            run_switch(state, state->session_count - 1);
+        return true;
+    }
+    if (ksym == XK_Prior || ksym == XK_Next) {
+        int step = (ksym == XK_Prior) ? state->session_count - 1 : 1;
+        run_switch(state, (state->active + step) % state->session_count);
+        return true;
+    }
+    return false;
+}
+
+/*!
+ * \brief Queue pasted text for shell, newlines become CR like typed Enter
+ *  ESC is dropped inside bracketed paste, so pasted text can't end the bracket itself.
+ */
+static void run_paste_data(run_state_t *state, const unsigned char *data, size_t n) {
+    if (!state->paste_session)
+        return;
+    pty_t *pty = state->paste_session->pty;
+    char chunk[READ_BUFFER_SIZE];
+    size_t length = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (data[i] == '\033' && state->paste_bracketed)
+            continue;
+        chunk[length++] = (char) (data[i] == '\n' ? '\r' : data[i]);
+        if (length == sizeof(chunk)) {
+            pty_queue(pty, chunk, length);
+            length = 0;
+        }
+    }
+    pty_queue(pty, chunk, length);
+}
+
+/*!
+ * \brief Ask owner of selection to convert it to UTF-8 into property of window, paste goes to the active session
+ */
+static void run_paste_request(run_state_t *state, Atom selection, Time time) {
+    term_t *term = state->term;
+    // Property is busy until INCR transfer ends
+    if (state->replaying || state->paste_incr)
+        return;
+    state->paste_session = state->sessions[state->active];
+    XConvertSelection(term->display, selection, term->atom_utf8, term->atom_paste, term->window, time);
+}
+
+/*!
+ * \brief Read pasted property in parts of PASTE_CHUNK and delete it, returns number of pasted bytes
+ *  Type of property is returned, INCR means the owner sends selection in parts.
+ */
+static size_t run_paste_read(run_state_t *state, Atom *type) {
+    term_t *term = state->term;
+    size_t total = 0;
+    long offset = 0;
+    unsigned long bytes_after = 0;
+    do {
+        unsigned char *data = NULL;
+        int format = 0;
+        unsigned long items = 0;
+        if (XGetWindowProperty(term->display, term->window, term->atom_paste, offset, PASTE_CHUNK / 4, False,
+                               AnyPropertyType, type, &format, &items, &bytes_after, &data) != Success)
+            break;
+        // INCR property only holds size estimate
+        if (format == 8 && *type != term->atom_incr) {
+            run_paste_data(state, data, items);
+            total += items;
+        }
+        XFree(data);
+        if (items == 0)
+            break;
+        // Offset is in 32-bit units
+        offset += (long) (items * (unsigned long) format / 32);
+    } while (bytes_after > 0);
+    XDeleteProperty(term->display, term->window, term->atom_paste);
+    return total;
+}
+
+/*!
+ * \brief Close bracket of paste and start writing it
+ */
+static void run_paste_end(run_state_t *state) {
+    if (state->paste_session) {
+        if (state->paste_bracketed)
+            pty_queue(state->paste_session->pty, "\033[201~", 6);
+        run_input_flush(state, state->paste_session);
+    }
+    state->paste_session = NULL;
+    state->paste_incr = false;
+}
+
+/*!
+ * \brief Handle converted selection: paste it whole or start INCR transfer
+ */
+static void run_paste_notify(run_state_t *state, XSelectionEvent *ev) {
+    term_t *term = state->term;
+    if (!state->paste_session)
+        return;
+    if (ev->property == None) {
+        // Owner can't give UTF-8, Latin-1 string is asked instead
+        if (ev->target == term->atom_utf8)
+            XConvertSelection(term->display, ev->selection, XA_STRING, term->atom_paste, term->window, ev->time);
+        else
+            state->paste_session = NULL;
+        return;
+    }
+    state->paste_bracketed = state->paste_session->screen->bracketed_paste;
+    if (state->paste_bracketed)
+        pty_queue(state->paste_session->pty, "\033[200~", 6);
+    Atom type = None;
+    run_paste_read(state, &type);
+    // Deleting INCR property has asked owner for the first part
+    if (type == term->atom_incr) {
+        state->paste_incr = true;
+        return;
+    }
+    run_paste_end(state);
+}
+
+/*!
+ * \brief Read the next part of INCR transfer, empty part ends it
+ *  Parts are written as they come, so big paste reaches the shell while the rest is being transferred.
+ */
+static void run_paste_incr(run_state_t *state, XPropertyEvent *ev) {
+    term_t *term = state->term;
+    if (!state->paste_incr || ev->atom != term->atom_paste || ev->state != PropertyNewValue)
+        return;
+    Atom type = None;
+    if (run_paste_read(state, &type) == 0)
+        run_paste_end(state);
+    else if (state->paste_session)
+        run_input_flush(state, state->paste_session);
+}
+
+/*!
+ * \brief Handle Shift+Insert (PRIMARY) and Ctrl+Shift+V (CLIPBOARD), returns true if key was consumed
+ */
+static bool run_paste_key(run_state_t *state, XKeyEvent *ev) {
+    KeySym ksym = XLookupKeysym(ev, 0);
+    if ((ev->state & ShiftMask) && ksym == XK_Insert) {
+        run_paste_request(state, XA_PRIMARY, ev->time);
+        return true;
+    }
+    if ((ev->state & ControlMask) && (ev->state & ShiftMask) && ksym == XK_v) {
+        run_paste_request(state, state->term->atom_clipboard, ev->time);
+        return true;
+    }
+    return false;
+}
+
+/*!
+ * \brief Get slot of owned text for selection, -1 for selections other than PRIMARY and CLIPBOARD
+ */
+static int run_copy_slot(run_state_t *state, Atom selection) {
+    if (selection == XA_PRIMARY)
+        return 0;
+    if (selection == state->term->atom_clipboard)
+        return 1;
+    return -1;
+}
+
+/*!
+ * \brief Own PRIMARY or CLIPBOARD with text selected on active screen
+ *  Text is taken once here, so requests of other clients are answered without walking history again.
+ */
+static void run_copy(run_state_t *state, Atom selection, Time time) {
+    term_t *term = state->term;
+    int slot = run_copy_slot(state, selection);
+    size_t length = 0;
+    char *text = select_text(term->model, &length);
+    if (!text)
+        return;
+    free(state->copy_text[slot]);
+    state->copy_text[slot] = text;
+    state->copy_length[slot] = length;
+    XSetSelectionOwner(term->display, selection, term->window, time);
+    if (XGetSelectionOwner(term->display, selection) != term->window) {
+        free(text);
+        state->copy_text[slot] = NULL;
+    }
+}
+
+/*!
+ * \brief Answer request of another client for text this window owns
+ *  Text goes in one property, so it's limited by the maximum request of server (16 MiB with BIG-REQUESTS).
+ *  STRING is Latin-1, so it's given only for ASCII text where both encodings are the same.
+ */
+static void run_copy_request(run_state_t *state, XSelectionRequestEvent *request) {
+    term_t *term = state->term;
+    int slot = run_copy_slot(state, request->selection);
+    XSelectionEvent reply = {
+        .type = SelectionNotify,
+        .display = request->display,
+        .requestor = request->requestor,
+        .selection = request->selection,
+        .target = request->target,
+        .property = None,
+        .time = request->time,
+    };
+    // Obsolete clients give no property and expect the target to be used as its name
+    Atom property = request->property != None ? request->property : request->target;
+    const char *text = slot >= 0 ? state->copy_text[slot] : NULL;
+    size_t length = slot >= 0 ? state->copy_length[slot] : 0;
+    long max_request = XExtendedMaxRequestSize(term->display);
+    size_t limit = (size_t) (max_request ? max_request : XMaxRequestSize(term->display)) * 4 - 1024;
+    bool ascii = true;
+    for (size_t i = 0; text && request->target == XA_STRING && i < length && ascii; i++)
+        ascii = (unsigned char) text[i] < 0x80;
+    if (!text) {
+        // Ownership was lost, request is refused
+    } else if (request->target == term->atom_targets) {
+        Atom targets[] = {term->atom_targets, term->atom_utf8, XA_STRING};
+        XChangeProperty(term->display, request->requestor, property, XA_ATOM, 32, PropModeReplace,
+                        (unsigned char *) targets, sizeof(targets) / sizeof(targets[0]));
+        reply.property = property;
+    } else if ((request->target == term->atom_utf8 || (request->target == XA_STRING && ascii)) && length <= limit) {
+        XChangeProperty(term->display, request->requestor, property, request->target, 8, PropModeReplace,
+                        (const unsigned char *) text, (int) length);
+        reply.property = property;
+    }
+    XSendEvent(term->display, request->requestor, False, NoEventMask, (XEvent *) &reply);
+}
+
+/*!
+ * \brief Forget text another client has taken selection from, highlight goes with PRIMARY
+ */
+static void run_copy_clear(run_state_t *state, XSelectionClearEvent *ev) {
+    int slot = run_copy_slot(state, ev->selection);
+    if (slot < 0)
+        return;
+    free(state->copy_text[slot]);
+    state->copy_text[slot] = NULL;
+    if (slot == 0) {
+        select_clear(state->term->model);
+        run_request_frame(state);
+    }
+}
+
+/*!
+ * \brief Start selection with button 1, double click selects words and triple click lines
+ */
+static void run_select_press(run_state_t *state, XButtonEvent *ev) {
+    term_t *term = state->term;
+    static const select_mode_t modes[] = {SELECT_CHAR, SELECT_WORD, SELECT_LINE};
+    int x = ev->x / term->font_width;
+    int y = ev->y / term->font_height;
+    bool repeat = ev->time - state->click_time < DOUBLE_CLICK_TIME && x == state->click_x && y == state->click_y;
+    state->click_count = repeat ? state->click_count % 3 + 1 : 1;
+    state->click_time = ev->time;
+    state->click_x = x;
+    state->click_y = y;
+    state->selecting = true;
+    select_start(term->model, x, y, modes[state->click_count - 1]);
+    run_request_frame(state);
+}
+
+/*!
+ * \brief Extend selection while button 1 is held
+ */
+static void run_select_motion(run_state_t *state, XMotionEvent *ev) {
+    term_t *term = state->term;
+    if (!state->selecting)
+        return;
+    select_extend(term->model, ev->x / term->font_width, ev->y / term->font_height);
+    run_request_frame(state);
+}
+
+/*!
+ * \brief End selection and own PRIMARY with its text
+ */
+static void run_select_release(run_state_t *state, XButtonEvent *ev) {
+    if (!state->selecting)
+        return;
+    state->selecting = false;
+    run_copy(state, XA_PRIMARY, ev->time);
+}
+
+/*!
+ * \brief Handle Ctrl+Shift+C (copy to CLIPBOARD), Ctrl+Shift+F (search) and keys of search, returns true if key was consumed
+ *  While search is on, typed text edits the query and view follows the nearest match above the bottom.
+ *  Enter or Up finds older match, Shift+Enter or Down newer one, Escape ends search leaving match selected.
+ */
+static bool run_search_key(run_state_t *state, XKeyEvent *ev) {
+    term_t *term = state->term;
+    screen_t *screen = term->model;
+    term_search_t *search = &screen->search;
+    KeySym ksym = XLookupKeysym(ev, 0);
+    bool ctrl_shift = (ev->state & ControlMask) && (ev->state & ShiftMask);
+    if (ctrl_shift && ksym == XK_c) {
+        run_copy(state, term->atom_clipboard, ev->time);
+        return true;
+    }
+    if (ctrl_shift && ksym == XK_f)
+        search->active = !search->active;
+    else if (!search->active || IsModifierKey(ksym))
+        return false;
+    else if (ksym == XK_Escape)
+        search->active = false;
+    else if (ksym == XK_Return || ksym == XK_KP_Enter || ksym == XK_Up || ksym == XK_Down)
+        search_next(screen, ksym == XK_Up || (ksym != XK_Down && !(ev->state & ShiftMask)));
+    else {
+        bool changed = false;
+        if (ksym == XK_BackSpace) {
+            search_backspace(screen);
+            changed = true;
+        } else {
+            // Keys are Latin-1 without input method, like the ones sent to shell
+            char buf[32] = {};
+            KeySym ignored = 0;
+            int n = XLookupString(ev, buf, sizeof(buf), &ignored, NULL);
+            for (int i = 0; i < n; i++)
+                changed = search_type(screen, (unsigned char) buf[i]) || changed;
+        }
+        if (changed && !search_next(screen, true))
+            select_clear(screen);
+    }
+    state->title_changed = true;
+    run_request_frame(state);
+    return true;
+}
+
+/*!
+ * \brief Resize screens and PTYs of all sessions to the window
+ */
+static void run_resize(run_state_t *state) {
+    term_t *term = state->term;
+    int width = term->width / term->font_width;
+    int height = term->height / term->font_height;
+    if (state->replaying)
+        screen_resize(term->model, width, height);
+    for (int i = 0; i < state->session_count; i++) {
+        screen_resize(state->sessions[i]->screen, width, height);
+        pty_resize(state->sessions[i]->pty, width, height);
+        if (state->sessions[i]->pty->record)
+            record_resize(state->sessions[i]->pty->record, width, height);
+    }
+}
+
+/*!
+ * \brief Reflow screens postponed while window was being resized
+ */
+static void run_resize_timer(term_loop_t *loop, void *data, uint32_t events) {
+    (void) loop;
+    (void) events;
+    run_state_t *state = data;
+    loop_timer_ack(state->fd_resize);
+    run_resize(state);
+    if (!state->frame_pending)
+        run_draw(state);
+}
+
+/*!
+ * \brief Handle events of X connection
+ */
+static void run_x_events(term_loop_t *loop, void *data, uint32_t events) {
+    (void) events;
+    run_state_t *state = data;
+    term_t *term = state->term;
+    XEvent event = {};
+    while (XPending(term->display)) {
+        XNextEvent(term->display, &event);
+        if (XFilterEvent(&event, None))
+            continue;
+        switch (event.type) {
+            case ClientMessage:
+                if (event.xclient.message_type == XInternAtom(term->display, "WM_PROTOCOLS", True) &&
+                    event.xclient.data.l[0] == (unsigned int) term->wm_delete) {
+                    loop->running = false;
                 }
+                break;
+            case DestroyNotify:
+                // Window destroyed externally
+                loop->running = false;
+                break;
+            // Window follows at once, screens are reflowed when resizing stops
+            case ConfigureNotify:
+                if (term_resize(term, &event))
+                    loop_timer_set(state->fd_resize, RESIZE_DELAY, 0);
+                break;
+            // Exposed area is restored from back buffer, it's drawn first if it has never been
+            case Expose:
+                if (term->model->damage_all)
+                    run_draw(state);
+                term_present(term, event.xexpose.x, event.xexpose.y, event.xexpose.width, event.xexpose.height);
+                break;
+            // Pass new key to shell
+            case KeyPress:
+                run_activity(state);
+                if (run_search_key(state, &event.xkey) || run_tab_key(state, &event.xkey) ||
+                    run_paste_key(state, &event.xkey))
+                    break;
+                // Replay has no shell, keys only scroll history
+                if (!term_scroll_key(term, &event.xkey) && !state->replaying)
+                    term_pty_write(state->sessions[state->active]->pty, &event.xkey);
+                if (term->model->view_changed)
+                    run_draw(state);
+                break;
+            // Button 1 selects text, middle button pastes PRIMARY selection
+            case ButtonPress:
+                if (event.xbutton.button == Button1)
+                    run_select_press(state, &event.xbutton);
+                else if (event.xbutton.button == Button2)
+                    run_paste_request(state, XA_PRIMARY, event.xbutton.time);
+                break;
+            case MotionNotify:
+                run_select_motion(state, &event.xmotion);
+                break;
+            case ButtonRelease:
+                if (event.xbutton.button == Button1)
+                    run_select_release(state, &event.xbutton);
+                break;
+            case SelectionNotify:
+                run_paste_notify(state, &event.xselection);
+                break;
+            case SelectionRequest:
+                run_copy_request(state, &event.xselectionrequest);
+                break;
+            case SelectionClear:
+                run_copy_clear(state, &event.xselectionclear);
+                break;
+            case PropertyNotify:
+                run_paste_incr(state, &event.xproperty);
+                break;
+            default:
+                break;
+        }
+    }
+    // Keys of the whole batch go to PTY with one write
+    for (int i = 0; i < state->session_count; i++)
+        run_input_flush(state, state->sessions[i]);
+}
+
+/*!
+ * \brief Handle output of shell, frame is drawn now or postponed to frame timer
+ *  Output of background sessions is only parsed, they are repainted whole when switched to.
+ */
+static void run_output(term_loop_t *loop, void *data, uint32_t events) {
+    run_session_t *session = data;
+    run_state_t *state = session->state;
+    if (events & EPOLLOUT)
+        run_input_flush(state, session);
+    // Space in PTY alone brings nothing to read
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        return;
+    if (!term_pty_read(session->screen, session->pty)) {
+        run_session_close(state, session);
+        return;
+    }
+    // Replies of parser
+    run_input_flush(state, session);
+    // Edge-triggered source isn't reported again for data left after read limit
+    if (session->pty->read_more)
+        loop_defer(loop, session->source);
+    if (session->screen != state->term->model)
+        return;
+    run_activity(state);
+    run_request_frame(state);
+}
+
+/*!
+ * \brief Write input queued while PTY of threaded session was full
+ */
+static void run_input(term_loop_t *loop, void *data, uint32_t events) {
+    (void) loop;
+    (void) events;
+    run_session_t *session = data;
+    run_input_flush(session->state, session);
+}
+
+/*!
+ * \brief Draw frame postponed by frame pacing
+ */
+static void run_frame(term_loop_t *loop, void *data, uint32_t events) {
+    (void) loop;
+    (void) events;
+    run_state_t *state = data;
+    loop_timer_ack(state->fd_frame);
+    state->frame_pending = false;
+    run_draw(state);
+}
+
+/*!
+ * \brief Toggle cursor, timer is disarmed when terminal is idle so it doesn't wake up the process
+ */
+static void run_blink(term_loop_t *loop, void *data, uint32_t events) {
+    (void) loop;
+    (void) events;
+    run_state_t *state = data;
+    term_t *term = state->term;
+    loop_timer_ack(state->fd_blink);
+    if (time_now_us() - state->active_last >= BLINK_IDLE_TIMEOUT) {
+        loop_timer_set(state->fd_blink, 0, 0);
+        state->blink_armed = false;
+        term->cursor_blink_off = false;
+    } else
+        term->cursor_blink_off = !term->cursor_blink_off;
+    // Pending frame draws cursor anyway
+    if (!state->frame_pending)
+        run_draw(state);
+}
+
+/*!
+ * \brief Resize screen and window to size stored in log, window size comes back through ConfigureNotify
+ */
+static void run_replay_resize(run_state_t *state, int width, int height) {
+    term_t *term = state->term;
+    if (width <= 0 || height <= 0)
+        return;
+    screen_resize(term->model, width, height);
+    XResizeWindow(term->display, term->window, (uint) (width * term->font_width), (uint) (height * term->font_height));
+}
+
+/*!
+ * \brief Feed records of log whose time has come to the screen, then wait for the next one
+ *  At max speed records aren't waited for, one read buffer of output is fed per call and the rest is deferred,
+ *  so frames are paced and X events are handled like with a flooding shell.
+ */
+static void run_replay(term_loop_t *loop, void *data, uint32_t events) {
+    (void) events;
+    run_state_t *state = data;
+    term_replay_t *replay = &state->replay;
+    screen_t *screen = state->term->model;
+    double speed = state->options->replay_speed;
+    loop_timer_ack(state->fd_replay);
+    unsigned long now = time_now_us();
+    size_t budget = READ_BUFFER_MAX;
+    while (state->replay_type != RECORD_END) {
+        if (speed > 0) {
+            unsigned long due = state->replay_start + (unsigned long) ((double) replay->time / speed);
+            if (due > now) {
+                loop_timer_set(state->fd_replay, due - now, 0);
+                break;
             }
+        } else if (budget == 0) {
+            loop_defer(loop, state->source_replay);
+            break;
         }
-        // PTY Master activity
-        if (FD_ISSET(pty->fd_master, &readable)) {
-            if (!term_pty_read(term, pty))
-                running = false;
-            term_draw(term);
+        if (state->replay_type == RECORD_OUTPUT) {
+            screen_output(screen, replay->output, replay->output_length);
+            // Replies have no shell to go to
+            screen->answer_length = 0;
+            budget -= MIN(budget, replay->output_length);
+        } else
+            run_replay_resize(state, replay->resize_width, replay->resize_height);
+        state->replay_type = replay_next(replay);
+    }
+    run_activity(state);
+    run_request_frame(state);
+    if (state->replay_type != RECORD_END)
+        return;
+    double seconds = (double) (time_now_us() - state->replay_start) / 1e6;
+    fprintf(stderr,
+            "Replayed %zu bytes in %lu records for %.3f s (%.1f MiB/s)\n",
+            replay->stats_bytes,
+            replay->stats_records,
+            seconds,
+            seconds > 0 ? (double) replay->stats_bytes / (1024 * 1024) / seconds : 0.0);
+    // Timed replay leaves the last screen to look at, max speed one is a benchmark and exits
+    loop_remove(loop, state->source_replay);
+    state->source_replay = NULL;
+    if (speed == 0) {
+        run_draw(state);
+        loop->running = false;
+    }
+}
+
+/*!
+ * \brief Show log in window instead of starting shell
+ */
+static bool run_replay_open(run_state_t *state) {
+    if (!replay_open(&state->replay, state->options->replay_path))
+        return false;
+    state->replaying = true;
+    state->fd_replay = loop_timer_new();
+    if (state->fd_replay == -1)
+        return false;
+    state->source_replay = loop_add(&state->loop, state->fd_replay, EPOLLIN, run_replay, state);
+    if (!state->source_replay)
+        return false;
+    run_replay_resize(state, state->replay.width, state->replay.height);
+    state->replay_type = replay_next(&state->replay);
+    state->replay_start = time_now_us();
+    loop_defer(&state->loop, state->source_replay);
+    return true;
+}
+
+/*!
+ * \brief Print statistics on SIGUSR1, they keep accumulating
+ */
+static void run_signal(term_loop_t *loop, void *data, uint32_t events) {
+    (void) loop;
+    (void) events;
+    run_state_t *state = data;
+    struct signalfd_siginfo info;
+    while (read(state->fd_signal, &info, sizeof(info)) == sizeof(info))
+        term_print_stats(state->term);
+}
+
+/*!
+ * \brief Take SIGUSR1 through signalfd, it must be blocked before reader and writer threads inherit the mask
+ */
+static bool run_signal_open(run_state_t *state) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+        perror("pthread_sigmask");
+        return false;
+    }
+    state->fd_signal = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (state->fd_signal == -1) {
+        perror("signalfd");
+        return false;
+    }
+    return loop_add(&state->loop, state->fd_signal, EPOLLIN, run_signal, state) != NULL;
+}
+
+/*!
+ * \brief Register X connection, shell output and timers in event loop
+ */
+static bool run_register(run_state_t *state) {
+    term_t *term = state->term;
+    state->source_x = loop_add(&state->loop, term->fd, EPOLLIN, run_x_events, state);
+    if (!state->source_x)
+        return false;
+    if (!loop_add(&state->loop, state->fd_frame, EPOLLIN, run_frame, state) ||
+        !loop_add(&state->loop, state->fd_blink, EPOLLIN, run_blink, state) ||
+        !loop_add(&state->loop, state->fd_resize, EPOLLIN, run_resize_timer, state))
+        return false;
+    if (term->print_stats && !run_signal_open(state))
+        return false;
+    if (state->options->replay_path) {
+        if (!run_replay_open(state))
+            return false;
+    } else {
+        // The first session uses PTY with options and screen created with window
+        if (!run_session_open(state, state->options, term->model))
+            return false;
+        if (state->options->record_path) {
+            state->recording = record_open(&state->record,
+                                           state->options->record_path,
+                                           term->model->buffer_width,
+                                           term->model->buffer_height);
+            if (!state->recording)
+                return false;
+            state->options->record = &state->record;
         }
     }
+    // Events queued by Xlib before the loop are never signaled on the socket
+    loop_defer(&state->loop, state->source_x);
+    run_activity(state);
     return true;
+}
+
+/*!
+ * \brief Main loop of terminal & pty life
+ *  Fds are registered in epoll once, PTY master is edge-triggered, frame pacing and blinking use timerfds.
+ */
+bool run(term_t *term, pty_t *pty) {
+    run_state_t state = {.term = term, .options = pty, .fd_replay = -1, .fd_signal = -1};
+    if (!loop_init(&state.loop))
+        return false;
+    state.fd_frame = loop_timer_new();
+    state.fd_blink = loop_timer_new();
+    state.fd_resize = loop_timer_new();
+    bool ok = state.fd_frame != -1 && state.fd_blink != -1 && state.fd_resize != -1 && run_register(&state) &&
+              loop_run(&state.loop);
+    while (state.session_count > 0)
+        run_session_close(&state, state.sessions[0]);
+    // Log is closed after shell is gone, so its last output is written too
+    if (state.recording)
+        record_close(&state.record);
+    if (state.replaying)
+        replay_close(&state.replay);
+    if (state.fd_replay != -1)
+        close(state.fd_replay);
+    if (state.fd_frame != -1)
+        close(state.fd_frame);
+    if (state.fd_blink != -1)
+        close(state.fd_blink);
+    if (state.fd_resize != -1)
+        close(state.fd_resize);
+    if (state.fd_signal != -1)
+        close(state.fd_signal);
+    free(state.copy_text[0]);
+    free(state.copy_text[1]);
+    loop_destroy(&state.loop);
+    return ok;
 }
\ No newline at end of file
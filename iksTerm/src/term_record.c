@@ -0,0 +1,314 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <main.h>
+#include <term_ring.h>
+#include <term_record.h>
+
+/*!
+ * \brief Get monotonic time in microseconds
+ */
+static unsigned long record_now() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ts.tv_sec * 1000000UL + (unsigned long) ts.tv_nsec / 1000UL;
+}
+
+/*!
+ * \brief Encode number as LEB128 varint, returns its size
+ */
+static size_t record_varint(char *out, uint64_t value) {
+    size_t size = 0;
+    do {
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        out[size++] = (char) (value ? byte | 0x80 : byte);
+    } while (value);
+    return size;
+}
+
+/*!
+ * \brief Write whole buffer to file, returns false on error
+ */
+static bool record_write_all(int fd, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t count = write(fd, data, n);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1) {
+            perror("write(record)");
+            return false;
+        }
+        data += count;
+        n -= (size_t) count;
+    }
+    return true;
+}
+
+/*!
+ * \brief Writer thread: put records from ring into file, exits when stopped and ring is drained
+ */
+static void *record_writer(void *arg) {
+    term_record_t *record = arg;
+    struct pollfd fd_wake = {.fd = record->fd_wake, .events = POLLIN};
+    bool ok = true;
+    while (true) {
+        const char *span;
+        size_t n = ring_read_span(&record->ring, &span);
+        if (n > 0) {
+            // After an error records are only consumed, so UI thread is never blocked by the broken file
+            ok = ok && record_write_all(record->fd, span, n);
+            ring_consume(&record->ring, n);
+            continue;
+        }
+        if (atomic_load(&record->writer_stop))
+            break;
+        // Flag is set before the check, so producer committing after it always wakes us
+        atomic_store(&record->writer_waiting, true);
+        if (ring_empty(&record->ring) && !atomic_load(&record->writer_stop) && poll(&fd_wake, 1, -1) > 0) {
+            uint64_t count;
+            if (read(record->fd_wake, &count, sizeof(count)) == -1 && errno != EAGAIN)
+                perror("read(eventfd)");
+        }
+        atomic_store(&record->writer_waiting, false);
+    }
+    return NULL;
+}
+
+/*!
+ * \brief Wake up writer if it sleeps on empty ring
+ */
+static void record_wake(term_record_t *record) {
+    uint64_t one = 1;
+    if (atomic_load(&record->writer_waiting) && write(record->fd_wake, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        perror("write(eventfd)");
+}
+
+/*!
+ * \brief Copy bytes into ring, sleeps while writer frees space if ring is full
+ *  Log must be exact, so nothing is dropped: with the ring of several MiB it happens only when disk is slower than shell.
+ */
+static void record_put(term_record_t *record, const char *data, size_t n) {
+    while (n > 0) {
+        char *span;
+        size_t space = ring_write_span(&record->ring, &span);
+        if (space == 0) {
+            record_wake(record);
+            nanosleep(&(struct timespec) {.tv_nsec = RECORD_FULL_SLEEP * 1000L}, NULL);
+            continue;
+        }
+        space = MIN(space, n);
+        memcpy(span, data, space);
+        ring_commit(&record->ring, space);
+        data += space;
+        n -= space;
+    }
+}
+
+/*!
+ * \brief Put record header: time since the previous record, payload length and type
+ */
+static void record_header(term_record_t *record, size_t length, record_type_t type) {
+    char header[2 * RECORD_VARINT_MAX];
+    unsigned long now = record_now();
+    size_t size = record_varint(header, now - record->time_last);
+    size += record_varint(header + size, (uint64_t) length << 1 | type);
+    record->time_last = now;
+    record_put(record, header, size);
+}
+
+/*!
+ * \brief Create log file and start writer thread, screen size is stored in log header
+ */
+bool record_open(term_record_t *record, const char *path, int width, int height) {
+    *record = (term_record_t) {.fd = -1, .fd_wake = -1};
+    record->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (record->fd == -1) {
+        perror(path);
+        return false;
+    }
+    record->fd_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (record->fd_wake == -1) {
+        perror("eventfd");
+        record_close(record);
+        return false;
+    }
+    if (!ring_init(&record->ring, RECORD_RING_SIZE)) {
+        record_close(record);
+        return false;
+    }
+    atomic_init(&record->writer_waiting, false);
+    atomic_init(&record->writer_stop, false);
+    int error = pthread_create(&record->writer, NULL, record_writer, record);
+    if (error) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        record_close(record);
+        return false;
+    }
+    record->writer_started = true;
+    char header[RECORD_MAGIC_SIZE + 2 * RECORD_VARINT_MAX];
+    memcpy(header, RECORD_MAGIC, RECORD_MAGIC_SIZE);
+    size_t size = RECORD_MAGIC_SIZE;
+    size += record_varint(header + size, (uint64_t) width);
+    size += record_varint(header + size, (uint64_t) height);
+    record_put(record, header, size);
+    record->time_last = record_now();
+    record_wake(record);
+    return true;
+}
+
+/*!
+ * \brief Append bytes written by shell
+ */
+void record_output(term_record_t *record, const char *data, size_t n) {
+    if (n == 0)
+        return;
+    record_header(record, n, RECORD_OUTPUT);
+    record_put(record, data, n);
+    record_wake(record);
+}
+
+/*!
+ * \brief Append new screen size
+ */
+void record_resize(term_record_t *record, int width, int height) {
+    char payload[2 * RECORD_VARINT_MAX];
+    size_t size = record_varint(payload, (uint64_t) width);
+    size += record_varint(payload + size, (uint64_t) height);
+    record_header(record, 0, RECORD_RESIZE);
+    record_put(record, payload, size);
+    record_wake(record);
+}
+
+/*!
+ * \brief Stop writer after it has written everything and close log
+ */
+void record_close(term_record_t *record) {
+    if (record->writer_started) {
+        atomic_store(&record->writer_stop, true);
+        uint64_t one = 1;
+        if (write(record->fd_wake, &one, sizeof(one)) == -1)
+            perror("write(eventfd)");
+        pthread_join(record->writer, NULL);
+        record->writer_started = false;
+    }
+    ring_destroy(&record->ring);
+    if (record->fd_wake != -1)
+        close(record->fd_wake);
+    if (record->fd != -1 && close(record->fd) == -1)
+        perror("close(record)");
+    record->fd_wake = -1;
+    record->fd = -1;
+}
+
+/*!
+ * \brief Decode LEB128 varint at offset, returns false if log ends inside it
+ */
+static bool replay_varint(term_replay_t *replay, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 7 * RECORD_VARINT_MAX && replay->offset < replay->size; shift += 7) {
+        unsigned char byte = (unsigned char) replay->data[replay->offset++];
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/*!
+ * \brief Map log into memory and read its header
+ */
+bool replay_open(term_replay_t *replay, const char *path) {
+    *replay = (term_replay_t) {};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return false;
+    }
+    replay->size = (size_t) st.st_size;
+    if (replay->size > 0) {
+        void *data = mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return false;
+        }
+        replay->data = data;
+        // Log is read once from start to end
+        madvise(data, replay->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    uint64_t width = 0, height = 0;
+    if (replay->size < RECORD_MAGIC_SIZE || memcmp(replay->data, RECORD_MAGIC, RECORD_MAGIC_SIZE)) {
+        fprintf(stderr, "%s: not a " TERM_NAME " record\n", path);
+        replay_close(replay);
+        return false;
+    }
+    replay->offset = RECORD_MAGIC_SIZE;
+    if (!replay_varint(replay, &width) || !replay_varint(replay, &height)) {
+        fprintf(stderr, "%s: broken header\n", path);
+        replay_close(replay);
+        return false;
+    }
+    replay->width = (int) MIN(width, INT16_MAX);
+    replay->height = (int) MIN(height, INT16_MAX);
+    return true;
+}
+
+/*!
+ * \brief Read the next record into `time` and `output` or `resize_*` fields, returns its type
+ *  Output points into the mapped log, nothing is copied. Truncated record of killed recorder ends replay.
+ */
+record_type_t replay_next(term_replay_t *replay) {
+    uint64_t delta, tag;
+    if (!replay_varint(replay, &delta) || !replay_varint(replay, &tag))
+        return RECORD_END;
+    replay->time += (unsigned long) delta;
+    uint64_t length = tag >> 1;
+    if ((tag & 1) == RECORD_RESIZE) {
+        uint64_t width, height;
+        if (!replay_varint(replay, &width) || !replay_varint(replay, &height))
+            return RECORD_END;
+        replay->resize_width = (int) MIN(width, INT16_MAX);
+        replay->resize_height = (int) MIN(height, INT16_MAX);
+        replay->stats_records++;
+        return RECORD_RESIZE;
+    }
+    if (length > replay->size - replay->offset)
+        return RECORD_END;
+    replay->output = replay->data + replay->offset;
+    replay->output_length = (size_t) length;
+    replay->offset += (size_t) length;
+    replay->stats_bytes += (size_t) length;
+    replay->stats_records++;
+    return RECORD_OUTPUT;
+}
+
+/*!
+ * \brief Unmap log
+ */
+void replay_close(term_replay_t *replay) {
+    if (replay->data)
+        munmap((void *) replay->data, replay->size);
+    replay->data = NULL;
+    replay->size = 0;
+}
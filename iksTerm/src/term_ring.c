@@ -0,0 +1,82 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <main.h>
+#include <term_ring.h>
+
+/*!
+ * \brief Allocate ring, capacity is rounded up to power of two
+ */
+bool ring_init(term_ring_t *ring, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity)
+        size *= 2;
+    ring->data = malloc(size);
+    if (!ring->data) {
+        perror("malloc");
+        return false;
+    }
+    ring->capacity = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return true;
+}
+
+/*!
+ * \brief Free ring storage
+ */
+void ring_destroy(term_ring_t *ring) {
+    free(ring->data);
+    ring->data = NULL;
+    ring->capacity = 0;
+}
+
+/*!
+ * \brief Get contiguous free space for producer, returns its size (0 if ring is full)
+ *  Index of the other side is loaded sequentially consistent, so a waiting flag stored before the call
+ *  and checked by the other side after its store can't miss a wakeup.
+ */
+size_t ring_write_span(term_ring_t *ring, char **span) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load(&ring->tail);
+    size_t offset = head & (ring->capacity - 1);
+    *span = ring->data + offset;
+    return MIN(ring->capacity - (head - tail), ring->capacity - offset);
+}
+
+/*!
+ * \brief Publish n bytes written into span to consumer
+ */
+void ring_commit(term_ring_t *ring, size_t n) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + n, memory_order_seq_cst);
+}
+
+/*!
+ * \brief Get contiguous written bytes for consumer, returns their number (0 if ring is empty)
+ */
+size_t ring_read_span(term_ring_t *ring, const char **span) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load(&ring->head);
+    size_t offset = tail & (ring->capacity - 1);
+    *span = ring->data + offset;
+    return MIN(head - tail, ring->capacity - offset);
+}
+
+/*!
+ * \brief Release n bytes read from span back to producer
+ */
+void ring_consume(term_ring_t *ring, size_t n) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_seq_cst);
+}
+
+/*!
+ * \brief Check that consumer has read everything
+ */
+bool ring_empty(term_ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire) == atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
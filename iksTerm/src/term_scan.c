@@ -0,0 +1,123 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+#include <main.h>
+#include <term_scan.h>
+
+/*!
+ * \brief Scalar kernel, used for tails and on CPUs without SIMD
+ */
+static size_t scan_printable_scalar(const unsigned char *buf, size_t n) {
+    size_t i = 0;
+    while (i < n && IS_PRINTABLE_ASCII(buf[i]))
+        i++;
+    return i;
+}
+
+#ifdef SCAN_X86
+/*!
+ * \brief SSE2 kernel, checks 16 bytes per step
+ *  Bytes are compared as signed, so everything >= 0x80 is negative and fails `> 0x1F`
+ */
+__attribute__((target("sse2"))) static size_t scan_printable_sse2(const unsigned char *buf, size_t n) {
+    const __m128i low = _mm_set1_epi8(0x1F);
+    const __m128i high = _mm_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (buf + i));
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(ok);
+        if (mask != 0xFFFF)
+            return i + (size_t) __builtin_ctz(~mask);
+    }
+    return i + scan_printable_scalar(buf + i, n - i);
+}
+
+/*!
+ * \brief AVX2 kernel, checks 32 bytes per step
+ */
+__attribute__((target("avx2"))) static size_t scan_printable_avx2(const unsigned char *buf, size_t n) {
+    const __m256i low = _mm256_set1_epi8(0x1F);
+    const __m256i high = _mm256_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (buf + i));
+        __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(ok);
+        if (mask != 0xFFFFFFFFu)
+            return i + (size_t) __builtin_ctz(~mask);
+    }
+    return i + scan_printable_sse2(buf + i, n - i);
+}
+#endif
+
+/*!
+ * @struct scan_kernel_t
+ * @brief Named kernel implementation
+ */
+typedef struct scan_kernel_t {
+    const char *name;       ///< Name of kernel
+    scan_printable_t kernel;///< Function
+} scan_kernel_t;
+
+static const scan_kernel_t scan_kernels[] = {
+#ifdef SCAN_X86
+    {"avx2", scan_printable_avx2},
+    {"sse2", scan_printable_sse2},
+#endif
+    {"scalar", scan_printable_scalar},
+};
+
+static const char *scan_selected = "scalar";
+
+scan_printable_t term_scan_printable = scan_printable_scalar;
+
+/*!
+ * \brief Check that CPU can run kernel
+ */
+static bool scan_supported(const char *name) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(name, "sse2"))
+        return __builtin_cpu_supports("sse2");
+#endif
+    return !strcmp(name, "scalar");
+}
+
+/*!
+ * \brief Select kernel by name, fails if it's unknown or unsupported by CPU
+ */
+bool term_scan_select(const char *name) {
+    for (size_t i = 0; i < sizeof(scan_kernels) / sizeof(scan_kernels[0]); i++) {
+        if (!strcmp(name, scan_kernels[i].name) && scan_supported(name)) {
+            term_scan_printable = scan_kernels[i].kernel;
+            scan_selected = scan_kernels[i].name;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * \brief Select the fastest kernel CPU supports at runtime
+ */
+void term_scan_init() {
+    for (size_t i = 0; i < sizeof(scan_kernels) / sizeof(scan_kernels[0]); i++)
+        if (term_scan_select(scan_kernels[i].name))
+            return;
+}
+
+/*!
+ * \brief Get name of selected kernel
+ */
+const char *term_scan_name() {
+    return scan_selected;
+}
@@ -0,0 +1,824 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+#include <term_utf8.h>
+#include <term_parser.h>
+#include <term_select.h>
+#include <term_screen.h>
+
+/*!
+ * \brief Setup empty screen of size in cells
+ *  Palette is shared with renderer, SGR truecolor values get their indices in it
+ */
+bool screen_init(screen_t *screen, term_palette_t *palette, int width, int height, size_t history_budget) {
+    *screen = (screen_t) {};
+    screen->palette = palette;
+    screen->pen = ATTR_DEFAULT;
+    term_parser_init();
+    if (!history_init(&screen->history, history_budget))
+        return false;
+    return screen_resize(screen, width, height);
+}
+
+/*!
+ * \brief Free all memory of screen
+ */
+void screen_destroy(screen_t *screen) {
+    free(screen->buffer);
+    free(screen->buffer_attrs);
+    free(screen->rows);
+    free(screen->damage_begin);
+    free(screen->damage_end);
+    free(screen->reflow_chars);
+    free(screen->reflow_attrs);
+    free(screen->reflow_ends);
+    free(screen->grid_hidden.buffer);
+    free(screen->grid_hidden.buffer_attrs);
+    free(screen->grid_hidden.rows);
+    select_destroy(&screen->select);
+    search_destroy(&screen->search);
+    history_destroy(&screen->history);
+    *screen = (screen_t) {};
+}
+
+/*!
+ * \brief Check if cell looks the same as never written one, such cells are trimmed at the end of logical line
+ */
+static bool screen_blank_cell(uint32_t c, term_attr_t attr) {
+    return c == 0 && attr == ATTR_DEFAULT;
+}
+
+/*!
+ * \brief Grow reflow scratch to hold cells and lines
+ */
+static bool screen_reserve_reflow(screen_t *screen, size_t cells, int lines) {
+    if (cells > screen->reflow_capacity) {
+        uint32_t *new_chars = realloc(screen->reflow_chars, cells * sizeof(uint32_t));
+        if (new_chars)
+            screen->reflow_chars = new_chars;
+        term_attr_t *new_attrs = realloc(screen->reflow_attrs, cells * sizeof(term_attr_t));
+        if (new_attrs)
+            screen->reflow_attrs = new_attrs;
+        if (!new_chars || !new_attrs) {
+            perror("realloc");
+            return false;
+        }
+        screen->reflow_capacity = cells;
+    }
+    if (lines > screen->reflow_lines) {
+        int *new_ends = realloc(screen->reflow_ends, (size_t) lines * sizeof(int));
+        if (!new_ends) {
+            perror("realloc");
+            return false;
+        }
+        screen->reflow_ends = new_ends;
+        screen->reflow_lines = lines;
+    }
+    return true;
+}
+
+/*!
+ * \brief Copy logical lines of screen into reflow scratch, returns their number or -1
+ *  Wrapped history rows continuing into the top row are taken back, they are a part of its line.
+ *  Rows below cursor and the last written row are left out. Cursor is returned as line and offset in it.
+ */
+static int screen_gather(screen_t *screen, int *cursor_line, int *cursor_offset) {
+    int width = screen->buffer_width;
+    int last = screen->buffer_y;
+    for (int y = screen->buffer_height - 1; y > last; y--) {
+        term_row_t *row = screen_row(screen, y);
+        bool row_has_content = false;
+        for (int x = 0; x < width && !row_has_content; x++)
+            row_has_content = !screen_blank_cell(row->chars[x], row->attrs[x]);
+        if (row_has_content)
+            last = y;
+    }
+    int pulled = 0;
+    size_t pulled_cells = 0;
+    bool wrapped = false;
+    int length;
+    while (pulled < REFLOW_HISTORY_ROWS && (length = history_line(&screen->history, (size_t) pulled, &wrapped)) >= 0 &&
+           wrapped) {
+        pulled_cells += (size_t) length;
+        pulled++;
+    }
+    if (!screen_reserve_reflow(screen, pulled_cells + (size_t) width * (size_t) (last + 1), last + 1))
+        return -1;
+
+    uint32_t *chars = screen->reflow_chars;
+    term_attr_t *attrs = screen->reflow_attrs;
+    int pos = 0;
+    for (int age = pulled - 1; age >= 0; age--) {
+        length = history_line(&screen->history, (size_t) age, &wrapped);
+        history_get(&screen->history, (size_t) age, chars + pos, attrs + pos, length);
+        pos += length;
+    }
+    for (int i = 0; i < pulled; i++)
+        history_pop(&screen->history);
+
+    int lines = 0;
+    int line_start = 0;
+    for (int y = 0; y <= last; y++) {
+        term_row_t *row = screen_row(screen, y);
+        bool line_end = !row->wrapped || y == last;
+        // Blank cell at the end of wrapped row is a padding left by double-width character
+        length = width;
+        while (length > 0 && screen_blank_cell(row->chars[length - 1], row->attrs[length - 1]))
+            length--;
+        if (y == screen->buffer_y) {
+            length = MAX(length, screen->buffer_x);
+            *cursor_line = lines;
+            *cursor_offset = pos - line_start + screen->buffer_x + (screen->wrap_pending ? 1 : 0);
+        }
+        memcpy(chars + pos, row->chars, (size_t) length * sizeof(uint32_t));
+        memcpy(attrs + pos, row->attrs, (size_t) length * sizeof(term_attr_t));
+        pos += length;
+        if (line_end) {
+            screen->reflow_ends[lines++] = pos;
+            line_start = pos;
+        }
+    }
+    return lines;
+}
+
+/*!
+ * \brief Get length of the next row of logical line, double-width character isn't split at the row end
+ */
+static int screen_reflow_row(const uint32_t *chars, int length, int width) {
+    if (length <= width)
+        return length;
+    if (width > 1 && chars[width] == CELL_WIDE_TAIL)
+        return width - 1;
+    return width;
+}
+
+/*!
+ * \brief Split gathered lines into rows of screen width, returns number of rows
+ *  Layout pass only finds cursor (row, col), emit pass writes rows: the first `drop` ones go to history.
+ */
+static int screen_reflow(screen_t *screen, int lines, int cursor_line, int cursor_offset, int drop, bool emit,
+                         int *cursor_row, int *cursor_col) {
+    const uint32_t *chars = screen->reflow_chars;
+    const term_attr_t *attrs = screen->reflow_attrs;
+    int width = screen->buffer_width;
+    int row = 0;
+    int start = 0;
+    for (int line = 0; line < lines; line++) {
+        int end = screen->reflow_ends[line];
+        int x = start;
+        do {
+            int length = screen_reflow_row(chars + x, end - x, width);
+            bool wrapped = x + length < end;
+            int offset = start + cursor_offset;
+            if (!emit && line == cursor_line && offset >= x && (offset < x + length || !wrapped)) {
+                *cursor_row = row;
+                *cursor_col = offset - x;
+            }
+            if (emit && row < drop) {
+                history_push(&screen->history, chars + x, attrs + x, length, wrapped);
+            } else if (emit && row - drop < screen->buffer_height) {
+                term_row_t *target = &screen->rows[row - drop];
+                memcpy(target->chars, chars + x, (size_t) length * sizeof(uint32_t));
+                memcpy(target->attrs, attrs + x, (size_t) length * sizeof(term_attr_t));
+                target->wrapped = wrapped;
+            }
+            x += length;
+            row++;
+        } while (x < end);
+        start = end;
+    }
+    return row;
+}
+
+/*!
+ * \brief Resize shown grid reflowing its logical lines to the new width
+ *  Storages are reallocated only when they grow, lines pushed out of the top go to history.
+ *  Only the screen and the line crossing into it are reflowed, so cost doesn't depend on history size.
+ */
+static bool screen_reflow_resize(screen_t *screen, int new_buffer_width, int new_buffer_height) {
+    size_t cells = (size_t) new_buffer_width * (size_t) new_buffer_height;
+    uint32_t *new_buffer = NULL;
+    term_attr_t *new_buffer_attrs = NULL;
+    term_row_t *new_rows = NULL;
+    int *new_damage_begin = NULL;
+    int *new_damage_end = NULL;
+    bool grow_cells = cells > screen->cell_capacity;
+    bool grow_rows = new_buffer_height > screen->row_capacity;
+    bool grow_damage = new_buffer_height > screen->damage_capacity;
+    if (grow_cells) {
+        new_buffer = malloc(cells * sizeof(uint32_t));
+        new_buffer_attrs = malloc(cells * sizeof(term_attr_t));
+    }
+    if (grow_rows)
+        new_rows = malloc((size_t) new_buffer_height * sizeof(term_row_t));
+    if (grow_damage) {
+        new_damage_begin = malloc((size_t) new_buffer_height * sizeof(int));
+        new_damage_end = malloc((size_t) new_buffer_height * sizeof(int));
+    }
+    int lines = 0;
+    int cursor_line = 0;
+    int cursor_offset = 0;
+    // Lines are copied out before storages are overwritten or freed
+    if ((grow_cells && (!new_buffer || !new_buffer_attrs)) ||
+        (grow_rows && !new_rows) || (grow_damage && (!new_damage_begin || !new_damage_end)) ||
+        (screen->buffer_height > 0 && (lines = screen_gather(screen, &cursor_line, &cursor_offset)) < 0)) {
+        perror("malloc");
+        free(new_buffer);
+        free(new_buffer_attrs);
+        free(new_rows);
+        free(new_damage_begin);
+        free(new_damage_end);
+        return false;
+    }
+    if (grow_cells) {
+        free(screen->buffer);
+        free(screen->buffer_attrs);
+        screen->buffer = new_buffer;
+        screen->buffer_attrs = new_buffer_attrs;
+        screen->cell_capacity = cells;
+    }
+    if (grow_rows) {
+        free(screen->rows);
+        screen->rows = new_rows;
+        screen->row_capacity = new_buffer_height;
+    }
+    if (grow_damage) {
+        free(screen->damage_begin);
+        free(screen->damage_end);
+        screen->damage_begin = new_damage_begin;
+        screen->damage_end = new_damage_end;
+        screen->damage_capacity = new_buffer_height;
+    }
+    screen->buffer_width = new_buffer_width;
+    screen->buffer_height = new_buffer_height;
+    screen->row_head = 0;
+    for (int i = 0; i < new_buffer_height; i++) {
+        screen->rows[i].chars = screen->buffer + (size_t) i * (size_t) new_buffer_width;
+        screen->rows[i].attrs = screen->buffer_attrs + (size_t) i * (size_t) new_buffer_width;
+        screen->rows[i].wrapped = false;
+        screen_clear_cells(&screen->rows[i], 0, new_buffer_width, ATTR_DEFAULT);
+    }
+
+    int cursor_row = 0;
+    int cursor_col = 0;
+    int total = screen_reflow(screen, lines, cursor_line, cursor_offset, 0, false, &cursor_row, &cursor_col);
+    // Top rows go to history, but never the cursor row
+    int drop = MAX(0, MIN(total - new_buffer_height, cursor_row));
+    screen_reflow(screen, lines, cursor_line, cursor_offset, drop, true, &cursor_row, &cursor_col);
+    screen->buffer_y = MIN(cursor_row - drop, new_buffer_height - 1);
+    screen->buffer_x = MIN(cursor_col, new_buffer_width - 1);
+    // Cursor right after the text filling its row keeps the deferred wrap
+    screen->wrap_pending = cursor_col >= new_buffer_width;
+
+    screen->view_offset = MIN(screen->view_offset, screen->history.line_count);
+    screen->scroll_pending = 0;
+    screen->scroll_top = 0;
+    screen->scroll_bottom = new_buffer_height;
+    screen_damage_all(screen);
+    return true;
+}
+
+/*!
+ * \brief Swap shown storages and cursor with the hidden ones, screens are switched by pointers
+ */
+static void screen_swap_grid(screen_t *screen) {
+    screen_grid_t shown = {
+        .buffer = screen->buffer,
+        .buffer_attrs = screen->buffer_attrs,
+        .rows = screen->rows,
+        .row_head = screen->row_head,
+        .cell_capacity = screen->cell_capacity,
+        .row_capacity = screen->row_capacity,
+        .width = screen->buffer_width,
+        .height = screen->buffer_height,
+        .cursor_x = screen->buffer_x,
+        .cursor_y = screen->buffer_y,
+        .wrap_pending = screen->wrap_pending,
+    };
+    screen_grid_t *hidden = &screen->grid_hidden;
+    screen->buffer = hidden->buffer;
+    screen->buffer_attrs = hidden->buffer_attrs;
+    screen->rows = hidden->rows;
+    screen->row_head = hidden->row_head;
+    screen->cell_capacity = hidden->cell_capacity;
+    screen->row_capacity = hidden->row_capacity;
+    screen->buffer_x = hidden->cursor_x;
+    screen->buffer_y = hidden->cursor_y;
+    screen->wrap_pending = hidden->wrap_pending;
+    *hidden = shown;
+}
+
+/*!
+ * \brief Lay out hidden grid for size with blank cells, storages only grow
+ */
+static bool screen_grid_fit(screen_grid_t *grid, int width, int height) {
+    size_t cells = (size_t) width * (size_t) height;
+    if (cells > grid->cell_capacity) {
+        uint32_t *new_buffer = malloc(cells * sizeof(uint32_t));
+        term_attr_t *new_buffer_attrs = malloc(cells * sizeof(term_attr_t));
+        if (!new_buffer || !new_buffer_attrs) {
+            perror("malloc");
+            free(new_buffer);
+            free(new_buffer_attrs);
+            return false;
+        }
+        free(grid->buffer);
+        free(grid->buffer_attrs);
+        grid->buffer = new_buffer;
+        grid->buffer_attrs = new_buffer_attrs;
+        grid->cell_capacity = cells;
+    }
+    if (height > grid->row_capacity) {
+        term_row_t *new_rows = malloc((size_t) height * sizeof(term_row_t));
+        if (!new_rows) {
+            perror("malloc");
+            return false;
+        }
+        free(grid->rows);
+        grid->rows = new_rows;
+        grid->row_capacity = height;
+    }
+    grid->row_head = 0;
+    grid->width = width;
+    grid->height = height;
+    for (int i = 0; i < height; i++) {
+        grid->rows[i].chars = grid->buffer + (size_t) i * (size_t) width;
+        grid->rows[i].attrs = grid->buffer_attrs + (size_t) i * (size_t) width;
+        grid->rows[i].wrapped = false;
+        screen_clear_cells(&grid->rows[i], 0, width, ATTR_DEFAULT);
+    }
+    grid->cursor_x = MIN(grid->cursor_x, width - 1);
+    grid->cursor_y = MIN(grid->cursor_y, height - 1);
+    grid->wrap_pending = false;
+    return true;
+}
+
+/*!
+ * \brief Resize screen, primary one is reflowed to the new width
+ *  Alternate screen is cleared instead: full-screen application redraws it after SIGWINCH.
+ */
+bool screen_resize(screen_t *screen, int new_buffer_width, int new_buffer_height) {
+    new_buffer_width = MAX(new_buffer_width, 1);
+    new_buffer_height = MAX(new_buffer_height, 1);
+    // Reflow renumbers screen lines and replaces wrapped lines it takes back from history, their matches are found again
+    size_t total = screen->history.line_total;
+    search_rewind(screen, total - MIN(total, (size_t) REFLOW_HISTORY_ROWS));
+    screen->search.found = false;
+    select_clear(screen);
+    if (!screen->alternate)
+        return screen_reflow_resize(screen, new_buffer_width, new_buffer_height);
+    screen_swap_grid(screen);
+    if (!screen_reflow_resize(screen, new_buffer_width, new_buffer_height)) {
+        screen_swap_grid(screen);
+        return false;
+    }
+    // Leaving alternate screen restores cursor at its reflowed position
+    screen->saved[0].x = screen->buffer_x;
+    screen->saved[0].y = screen->buffer_y;
+    screen->saved[0].wrap_pending = screen->wrap_pending;
+    if (!screen_grid_fit(&screen->grid_hidden, new_buffer_width, new_buffer_height)) {
+        screen->alternate = false;
+        return false;
+    }
+    screen_swap_grid(screen);
+    return true;
+}
+
+/*!
+ * \brief Show alternate or primary screen, they are switched by swapping storage pointers in O(1)
+ *  Alternate screen is allocated blank on the first use and laid out again only after resize of primary one.
+ *  Cursor stays where it is, DECSET 1049 saves and restores it and clears alternate screen around the switch.
+ */
+void screen_set_alternate(screen_t *screen, bool enable) {
+    if (enable == screen->alternate)
+        return;
+    screen_grid_t *hidden = &screen->grid_hidden;
+    if (enable && (hidden->width != screen->buffer_width || hidden->height != screen->buffer_height) &&
+        !screen_grid_fit(hidden, screen->buffer_width, screen->buffer_height))
+        return;
+    int x = screen->buffer_x;
+    int y = screen->buffer_y;
+    select_clear(screen);
+    screen->search.found = false;
+    screen_swap_grid(screen);
+    screen->alternate = enable;
+    if (enable) {
+        screen->buffer_x = x;
+        screen->buffer_y = y;
+    }
+    // History belongs to primary screen, view returns to the live one
+    screen->view_offset = 0;
+    screen_damage_all(screen);
+}
+
+/*!
+ * \brief Get attributes of erased cell: default colors with background of pen (BCE)
+ */
+static term_attr_t screen_blank_attr(screen_t *screen) {
+    return ATTR_SET_BG(ATTR_DEFAULT, ATTR_BG(screen->pen));
+}
+
+/*!
+ * \brief Mark columns [x_begin, x_end) of row y as changed since the last frame
+ */
+void screen_damage(screen_t *screen, int y, int x_begin, int x_end) {
+    if (y < 0 || y >= screen->buffer_height)
+        return;
+    x_begin = MAX(x_begin, 0);
+    x_end = MIN(x_end, screen->buffer_width);
+    if (x_begin >= x_end)
+        return;
+    if (screen->damage_begin[y] >= screen->damage_end[y]) {
+        screen->damage_begin[y] = x_begin;
+        screen->damage_end[y] = x_end;
+        return;
+    }
+    screen->damage_begin[y] = MIN(screen->damage_begin[y], x_begin);
+    screen->damage_end[y] = MAX(screen->damage_end[y], x_end);
+}
+
+/*!
+ * \brief Mark whole rows [y_begin, y_end) as changed
+ */
+void screen_damage_rows(screen_t *screen, int y_begin, int y_end) {
+    y_begin = MAX(y_begin, 0);
+    y_end = MIN(y_end, screen->buffer_height);
+    for (int y = y_begin; y < y_end; y++) {
+        screen->damage_begin[y] = 0;
+        screen->damage_end[y] = screen->buffer_width;
+    }
+}
+
+/*!
+ * \brief Mark whole window for repaint, including margins out of the grid
+ */
+void screen_damage_all(screen_t *screen) {
+    screen_damage_rows(screen, 0, screen->buffer_height);
+    screen->damage_all = true;
+}
+
+/*!
+ * \brief Scroll view through history by lines, negative count scrolls towards the screen
+ */
+void screen_scroll_view(screen_t *screen, int count) {
+    // History belongs to primary screen, it doesn't continue the alternate one
+    if (screen->alternate)
+        return;
+    long offset = (long) screen->view_offset + count;
+    offset = MAX(0, MIN(offset, (long) screen->history.line_count));
+    if ((size_t) offset == screen->view_offset)
+        return;
+    screen->view_offset = (size_t) offset;
+    screen->view_changed = true;
+}
+
+/*!
+ * \brief Check that scroll region covers the whole screen
+ */
+static bool screen_region_full(screen_t *screen) {
+    return screen->scroll_top == 0 && screen->scroll_bottom == screen->buffer_height;
+}
+
+/*!
+ * \brief Swap row descriptors of [begin, end) end to end
+ */
+static void screen_reverse_rows(screen_t *screen, int begin, int end) {
+    for (end--; begin < end; begin++, end--) {
+        term_row_t *a = screen_row(screen, begin);
+        term_row_t *b = screen_row(screen, end);
+        term_row_t row = *a;
+        *a = *b;
+        *b = row;
+    }
+}
+
+/*!
+ * \brief Rotate rows [top, bottom) up by count (down for negative one), rows that come in are blanked
+ *  Only row descriptors are moved by three reversals, cells stay in place, so it costs O(rows) for any width.
+ */
+void screen_rotate_rows(screen_t *screen, int top, int bottom, int count) {
+    int height = bottom - top;
+    if (height <= 0 || count == 0)
+        return;
+    count = MAX(-height, MIN(count, height));
+    int shift = count > 0 ? count : height + count;
+    screen_reverse_rows(screen, top, top + shift);
+    screen_reverse_rows(screen, top + shift, bottom);
+    screen_reverse_rows(screen, top, bottom);
+    int blank_begin = count > 0 ? bottom - count : top;
+    int blank_end = count > 0 ? bottom : top - count;
+    for (int y = blank_begin; y < blank_end; y++) {
+        screen_clear_cells(screen_row(screen, y), 0, screen->buffer_width, screen_blank_attr(screen));
+        screen_row(screen, y)->wrapped = false;
+    }
+    screen_damage_rows(screen, top, bottom);
+}
+
+/*!
+ * \brief Scroll screen or scroll region for one line
+ *  Rows live in a ring, so scrolling the whole screen is moving the head and clearing the row that became the bottom
+ *  one. Only primary screen scrolled as whole feeds history.
+ */
+void screen_scroll_up(screen_t *screen) {
+    if (!screen_region_full(screen)) {
+        screen_rotate_rows(screen, screen->scroll_top, screen->scroll_bottom, 1);
+        return;
+    }
+    term_row_t *top = screen_row(screen, 0);
+    if (!screen->alternate) {
+        history_push(&screen->history, top->chars, top->attrs, screen->buffer_width, top->wrapped);
+        // Scrolled back view stays on the same lines
+        if (screen->view_offset > 0)
+            screen->view_offset = MIN(screen->view_offset + 1, screen->history.line_count);
+    }
+    screen->stats_scrolls++;
+    screen_clear_cells(top, 0, screen->buffer_width, screen_blank_attr(screen));
+    top->wrapped = false;
+    screen->row_head++;
+    if (screen->row_head >= screen->buffer_height)
+        screen->row_head = 0;
+    // Damage moves together with rows, on-screen pixels are moved by `term_draw` with XCopyArea
+    memmove(screen->damage_begin, screen->damage_begin + 1, (size_t) (screen->buffer_height - 1) * sizeof(int));
+    memmove(screen->damage_end, screen->damage_end + 1, (size_t) (screen->buffer_height - 1) * sizeof(int));
+    screen->damage_begin[screen->buffer_height - 1] = screen->damage_end[screen->buffer_height - 1] = 0;
+    screen_damage_rows(screen, screen->buffer_height - 1, screen->buffer_height);
+    screen->scroll_pending++;
+}
+
+/*!
+ * \brief Scroll screen or scroll region for one line back, top row becomes empty
+ */
+void screen_scroll_down(screen_t *screen) {
+    if (!screen_region_full(screen)) {
+        screen_rotate_rows(screen, screen->scroll_top, screen->scroll_bottom, -1);
+        return;
+    }
+    screen->row_head--;
+    if (screen->row_head < 0)
+        screen->row_head = screen->buffer_height - 1;
+    screen_clear_cells(screen_row(screen, 0), 0, screen->buffer_width, screen_blank_attr(screen));
+    screen_row(screen, 0)->wrapped = false;
+    // Pixels can't be reused for this rare case
+    screen_damage_rows(screen, 0, screen->buffer_height);
+}
+
+/*!
+ * \brief Move cursor to the next line, scrolling at the bottom of scroll region
+ */
+void screen_line_feed(screen_t *screen) {
+    screen->wrap_pending = false;
+    if (screen->buffer_y == screen->scroll_bottom - 1)
+        screen_scroll_up(screen);
+    else if (screen->buffer_y < screen->buffer_height - 1)
+        screen->buffer_y++;
+}
+
+/*!
+ * \brief Move cursor to the previous line, scrolling back at the top of scroll region (RI)
+ */
+void screen_reverse_line_feed(screen_t *screen) {
+    screen->wrap_pending = false;
+    if (screen->buffer_y == screen->scroll_top)
+        screen_scroll_down(screen);
+    else if (screen->buffer_y > 0)
+        screen->buffer_y--;
+}
+
+/*!
+ * \brief Insert blank lines at cursor row pushing the rest of scroll region down (IL)
+ */
+void screen_insert_lines(screen_t *screen, int count) {
+    if (screen->buffer_y < screen->scroll_top || screen->buffer_y >= screen->scroll_bottom)
+        return;
+    screen_rotate_rows(screen, screen->buffer_y, screen->scroll_bottom, -count);
+    screen->buffer_x = 0;
+    screen->wrap_pending = false;
+}
+
+/*!
+ * \brief Delete lines at cursor row pulling the rest of scroll region up (DL)
+ */
+void screen_delete_lines(screen_t *screen, int count) {
+    if (screen->buffer_y < screen->scroll_top || screen->buffer_y >= screen->scroll_bottom)
+        return;
+    screen_rotate_rows(screen, screen->buffer_y, screen->scroll_bottom, count);
+    screen->buffer_x = 0;
+    screen->wrap_pending = false;
+}
+
+/*!
+ * \brief Set scroll region to rows [top, bottom) and home cursor (DECSTBM), region must hold two rows at least
+ */
+void screen_set_region(screen_t *screen, int top, int bottom) {
+    top = MAX(top, 0);
+    bottom = MIN(bottom, screen->buffer_height);
+    if (bottom - top < 2)
+        return;
+    screen->scroll_top = top;
+    screen->scroll_bottom = bottom;
+    screen_cursor_to(screen, 0, 0);
+}
+
+/*!
+ * \brief Save cursor with pen for the shown screen (DECSC)
+ */
+void screen_save_cursor(screen_t *screen) {
+    screen->saved[screen->alternate] = (screen_cursor_t) {
+        .x = screen->buffer_x,
+        .y = screen->buffer_y,
+        .wrap_pending = screen->wrap_pending,
+        .pen = screen->pen,
+        .valid = true,
+    };
+}
+
+/*!
+ * \brief Restore cursor saved for the shown screen (DECRC), without saved one cursor goes home with default pen
+ */
+void screen_restore_cursor(screen_t *screen) {
+    screen_cursor_t *saved = &screen->saved[screen->alternate];
+    if (!saved->valid) {
+        screen->pen = ATTR_DEFAULT;
+        screen_cursor_to(screen, 0, 0);
+        return;
+    }
+    screen_cursor_to(screen, saved->x, saved->y);
+    screen->wrap_pending = saved->wrap_pending && screen->buffer_x == saved->x;
+    screen->pen = saved->pen;
+}
+
+/*!
+ * \brief Blank halves of double-width characters that stick out of [x_begin, x_end), cells inside will be overwritten
+ */
+static void screen_split_wide(screen_t *screen, int y, int x_begin, int x_end) {
+    term_row_t *row = screen_row(screen, y);
+    if (x_begin > 0 && row->chars[x_begin] == CELL_WIDE_TAIL) {
+        row->chars[x_begin - 1] = ' ';
+        screen_damage(screen, y, x_begin - 1, x_begin);
+    }
+    if (x_end < screen->buffer_width && row->chars[x_end] == CELL_WIDE_TAIL) {
+        row->chars[x_end] = ' ';
+        screen_damage(screen, y, x_end, x_end + 1);
+    }
+}
+
+/*!
+ * \brief Write run of printable characters at cursor with auto wrap
+ *  Wrap is deferred until the next character, so a line that exactly fills the row doesn't produce an empty one
+ */
+void screen_put_run(screen_t *screen, const char *text, size_t len) {
+    while (len > 0) {
+        if (screen->wrap_pending) {
+            screen_row(screen, screen->buffer_y)->wrapped = true;
+            screen->buffer_x = 0;
+            screen_line_feed(screen);
+        }
+        size_t count = MIN(len, (size_t) (screen->buffer_width - screen->buffer_x));
+        term_row_t *row = screen_row(screen, screen->buffer_y);
+        screen_split_wide(screen, screen->buffer_y, screen->buffer_x, screen->buffer_x + (int) count);
+        uint32_t *chars = row->chars + screen->buffer_x;
+        term_attr_t *attrs = row->attrs + screen->buffer_x;
+        for (size_t i = 0; i < count; i++) {
+            chars[i] = (unsigned char) text[i];
+            attrs[i] = screen->pen;
+        }
+        screen_damage(screen, screen->buffer_y, screen->buffer_x, screen->buffer_x + (int) count);
+        screen->buffer_x += (int) count;
+        text += count;
+        len -= count;
+        if (screen->buffer_x >= screen->buffer_width) {
+            screen->buffer_x = screen->buffer_width - 1;
+            screen->wrap_pending = true;
+        }
+    }
+}
+
+/*!
+ * \brief Write one decoded character at cursor, double-width one takes two cells
+ *  Combining characters are not composed with previous cell, they are dropped.
+ */
+void screen_put_char(screen_t *screen, uint32_t c) {
+    int width = utf8_width(c);
+    if (width == 0)
+        return;
+    if (width == 2 && screen->buffer_width < 2)
+        width = 1;
+    // Double-width character doesn't fit into the last column, so it's wrapped as whole
+    if (screen->wrap_pending || (width == 2 && screen->buffer_x == screen->buffer_width - 1)) {
+        screen_row(screen, screen->buffer_y)->wrapped = true;
+        screen->buffer_x = 0;
+        screen_line_feed(screen);
+    }
+    term_row_t *row = screen_row(screen, screen->buffer_y);
+    int x = screen->buffer_x;
+    screen_split_wide(screen, screen->buffer_y, x, x + width);
+    row->chars[x] = c;
+    row->attrs[x] = screen->pen;
+    if (width == 2) {
+        row->chars[x + 1] = CELL_WIDE_TAIL;
+        row->attrs[x + 1] = screen->pen;
+    }
+    screen_damage(screen, screen->buffer_y, x, x + width);
+    screen->buffer_x += width;
+    if (screen->buffer_x >= screen->buffer_width) {
+        screen->buffer_x = screen->buffer_width - 1;
+        screen->wrap_pending = true;
+    }
+}
+
+/*!
+ * \brief Move cursor to (x,y) clamped by screen
+ */
+void screen_cursor_to(screen_t *screen, int x, int y) {
+    screen->buffer_x = MAX(0, MIN(x, screen->buffer_width - 1));
+    screen->buffer_y = MAX(0, MIN(y, screen->buffer_height - 1));
+    screen->wrap_pending = false;
+}
+
+/*!
+ * \brief Set cells [x_begin, x_end) of row blank with attributes
+ */
+void screen_clear_cells(term_row_t *row, int x_begin, int x_end, term_attr_t attr) {
+    for (int x = x_begin; x < x_end; x++) {
+        row->chars[x] = 0;
+        row->attrs[x] = attr;
+    }
+}
+
+/*!
+ * \brief Clear columns [x_begin, x_end) of row y, they keep background of pen
+ */
+void screen_erase(screen_t *screen, int y, int x_begin, int x_end) {
+    x_begin = MAX(x_begin, 0);
+    x_end = MIN(x_end, screen->buffer_width);
+    if (y < 0 || y >= screen->buffer_height || x_begin >= x_end)
+        return;
+    screen_split_wide(screen, y, x_begin, x_end);
+    screen_clear_cells(screen_row(screen, y), x_begin, x_end, screen_blank_attr(screen));
+    // Erased row end breaks the logical line
+    if (x_end == screen->buffer_width)
+        screen_row(screen, y)->wrapped = false;
+    screen_damage(screen, y, x_begin, x_end);
+}
+
+/*!
+ * \brief Insert blank cells at cursor shifting rest of row right (ICH)
+ */
+void screen_insert_blanks(screen_t *screen, int count) {
+    term_row_t *row = screen_row(screen, screen->buffer_y);
+    int x = screen->buffer_x;
+    count = MIN(count, screen->buffer_width - x);
+    size_t moved = (size_t) (screen->buffer_width - x - count);
+    memmove(row->chars + x + count, row->chars + x, moved * sizeof(uint32_t));
+    memmove(row->attrs + x + count, row->attrs + x, moved * sizeof(term_attr_t));
+    screen_erase(screen, screen->buffer_y, x, x + count);
+    screen_damage(screen, screen->buffer_y, x, screen->buffer_width);
+}
+
+/*!
+ * \brief Delete cells at cursor shifting rest of row left (DCH)
+ */
+void screen_delete_chars(screen_t *screen, int count) {
+    term_row_t *row = screen_row(screen, screen->buffer_y);
+    int x = screen->buffer_x;
+    count = MIN(count, screen->buffer_width - x);
+    size_t moved = (size_t) (screen->buffer_width - x - count);
+    memmove(row->chars + x, row->chars + x + count, moved * sizeof(uint32_t));
+    memmove(row->attrs + x, row->attrs + x + count, moved * sizeof(term_attr_t));
+    screen_erase(screen, screen->buffer_y, screen->buffer_width - count, screen->buffer_width);
+    screen_damage(screen, screen->buffer_y, x, screen->buffer_width);
+}
+
+/*!
+ * \brief Queue reply to the shell, it is written to PTY after parsing
+ */
+void screen_answer(screen_t *screen, const char *answer, int length) {
+    if (screen->answer_length + length > (int) sizeof(screen->answer))
+        return;
+    memcpy(screen->answer + screen->answer_length, answer, (size_t) length);
+    screen->answer_length += length;
+}
+
+/*!
+ * \brief Set cursor to (0,0)
+ */
+void screen_cursor_home(screen_t *screen) {
+    screen_cursor_to(screen, 0, 0);
+}
+
+/*!
+ * \brief Clear window buffer`
+ */
+void screen_clear(screen_t *screen) {
+    for (int y = 0; y < screen->buffer_height; y++) {
+        screen_clear_cells(screen_row(screen, y), 0, screen->buffer_width, screen_blank_attr(screen));
+        screen_row(screen, y)->wrapped = false;
+    }
+    screen_damage_rows(screen, 0, screen->buffer_height);
+}
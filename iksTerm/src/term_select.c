@@ -0,0 +1,545 @@
+// memmem
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+#include <term_utf8.h>
+#include <term_parser.h>
+#include <term_select.h>
+#include <term_screen.h>
+
+/*!
+ * \brief Compare cells in text order
+ */
+static int select_compare(select_point_t a, select_point_t b) {
+    if (a.line != b.line)
+        return a.line < b.line ? -1 : 1;
+    return (a.x > b.x) - (a.x < b.x);
+}
+
+/*!
+ * \brief Get absolute line number of view row y
+ */
+static size_t select_view_line(screen_t *screen, int y) {
+    return screen->history.line_total - screen->view_offset + (size_t) y;
+}
+
+/*!
+ * \brief Get cells of absolute line and whether it's wrapped, NULL if line is evicted or below the screen
+ *  History line is expanded into scratch row, it's valid until the next call.
+ */
+static const uint32_t *select_line(screen_t *screen, size_t line, bool *wrapped) {
+    term_select_t *select = &screen->select;
+    size_t total = screen->history.line_total;
+    int width = screen->buffer_width;
+    if (line >= total) {
+        if (line - total >= (size_t) screen->buffer_height)
+            return NULL;
+        term_row_t *row = screen_row(screen, (int) (line - total));
+        *wrapped = row->wrapped;
+        return row->chars;
+    }
+    size_t age = total - 1 - line;
+    if (history_line(&screen->history, age, wrapped) < 0)
+        return NULL;
+    if (width > select->scratch_width) {
+        uint32_t *new_chars = realloc(select->chars, (size_t) width * sizeof(uint32_t));
+        if (new_chars)
+            select->chars = new_chars;
+        term_attr_t *new_attrs = realloc(select->attrs, (size_t) width * sizeof(term_attr_t));
+        if (new_attrs)
+            select->attrs = new_attrs;
+        if (!new_chars || !new_attrs) {
+            perror("realloc");
+            return NULL;
+        }
+        select->scratch_width = width;
+    }
+    history_get(&screen->history, age, select->chars, select->attrs, width);
+    return select->chars;
+}
+
+/*!
+ * \brief Get class of character for word selection: 0 for blank, 1 for delimiter, 2 for word
+ */
+static int select_class(uint32_t c) {
+    if (c == 0 || c == ' ')
+        return 0;
+    if (c < 0x80 && strchr(SELECT_DELIMITERS, (int) c))
+        return 1;
+    return 2;
+}
+
+/*!
+ * \brief Damage view rows of selected lines
+ */
+static void select_damage(screen_t *screen) {
+    term_select_t *select = &screen->select;
+    if (!select->active)
+        return;
+    size_t top = select_view_line(screen, 0);
+    size_t bottom = top + (size_t) screen->buffer_height;
+    if (select->end.line < top || select->begin.line >= bottom)
+        return;
+    int y_begin = select->begin.line > top ? (int) (select->begin.line - top) : 0;
+    int y_end = select->end.line < bottom ? (int) (select->end.line - top) + 1 : screen->buffer_height;
+    screen_damage_rows(screen, y_begin, y_end);
+}
+
+/*!
+ * \brief Order anchor and head into selected range, it's expanded to words or lines and never splits wide character
+ */
+static void select_update(screen_t *screen) {
+    term_select_t *select = &screen->select;
+    int width = screen->buffer_width;
+    select_damage(screen);
+    bool forward = select_compare(select->anchor, select->head) <= 0;
+    select->begin = forward ? select->anchor : select->head;
+    select->end = forward ? select->head : select->anchor;
+    if (select->mode == SELECT_LINE) {
+        select->begin.x = 0;
+        select->end.x = width - 1;
+    }
+    // Begin and end are expanded one after another, lines share scratch row
+    bool wrapped = false;
+    const uint32_t *cells = select_line(screen, select->begin.line, &wrapped);
+    if (cells && select->mode == SELECT_WORD) {
+        int class = select_class(cells[select->begin.x]);
+        while (class != 1 && select->begin.x > 0 && select_class(cells[select->begin.x - 1]) == class)
+            select->begin.x--;
+    }
+    if (cells && select->begin.x > 0 && cells[select->begin.x] == CELL_WIDE_TAIL)
+        select->begin.x--;
+    cells = select_line(screen, select->end.line, &wrapped);
+    if (cells && select->mode == SELECT_WORD) {
+        int class = select_class(cells[select->end.x]);
+        while (class != 1 && select->end.x < width - 1 && select_class(cells[select->end.x + 1]) == class)
+            select->end.x++;
+    }
+    if (cells && select->end.x < width - 1 && cells[select->end.x + 1] == CELL_WIDE_TAIL)
+        select->end.x++;
+    // Click without drag selects nothing
+    select->active = select->mode != SELECT_CHAR || select_compare(select->anchor, select->head) != 0;
+    select_damage(screen);
+}
+
+/*!
+ * \brief Start selection at cell of view, previous selection is dropped
+ */
+void select_start(screen_t *screen, int x, int y, select_mode_t mode) {
+    term_select_t *select = &screen->select;
+    x = MAX(0, MIN(x, screen->buffer_width - 1));
+    y = MAX(0, MIN(y, screen->buffer_height - 1));
+    select->anchor = select->head = (select_point_t) {.line = select_view_line(screen, y), .x = x};
+    select->mode = mode;
+    select_update(screen);
+}
+
+/*!
+ * \brief Extend selection to cell of view
+ */
+void select_extend(screen_t *screen, int x, int y) {
+    term_select_t *select = &screen->select;
+    x = MAX(0, MIN(x, screen->buffer_width - 1));
+    y = MAX(0, MIN(y, screen->buffer_height - 1));
+    select->head = (select_point_t) {.line = select_view_line(screen, y), .x = x};
+    select_update(screen);
+}
+
+/*!
+ * \brief Select cells [begin, end], even a single one
+ */
+void select_set(screen_t *screen, select_point_t begin, select_point_t end) {
+    term_select_t *select = &screen->select;
+    select->anchor = begin;
+    select->head = end;
+    select->mode = SELECT_CHAR;
+    select_update(screen);
+    select->active = true;
+    select_damage(screen);
+}
+
+/*!
+ * \brief Drop selection
+ */
+void select_clear(screen_t *screen) {
+    select_damage(screen);
+    screen->select.active = false;
+}
+
+/*!
+ * \brief Get selected columns [x_begin, x_end) of view row, returns false if none is selected
+ */
+bool select_span(screen_t *screen, int y, int *x_begin, int *x_end) {
+    term_select_t *select = &screen->select;
+    if (!select->active)
+        return false;
+    size_t line = select_view_line(screen, y);
+    if (line < select->begin.line || line > select->end.line)
+        return false;
+    *x_begin = line == select->begin.line ? select->begin.x : 0;
+    *x_end = line == select->end.line ? MIN(select->end.x + 1, screen->buffer_width) : screen->buffer_width;
+    return *x_begin < *x_end;
+}
+
+/*!
+ * \brief Append bytes to growing text, it's freed if memory is over
+ */
+static bool select_append(char **text, size_t *length, size_t *capacity, const char *data, size_t n) {
+    if (*length + n > *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : READ_BUFFER_SIZE;
+        while (new_capacity < *length + n)
+            new_capacity *= 2;
+        char *new_text = realloc(*text, new_capacity);
+        if (!new_text) {
+            perror("realloc");
+            free(*text);
+            *text = NULL;
+            return false;
+        }
+        *text = new_text;
+        *capacity = new_capacity;
+    }
+    memcpy(*text + *length, data, n);
+    *length += n;
+    return true;
+}
+
+/*!
+ * \brief Get selected text in UTF-8, it's allocated and must be freed, NULL if nothing is selected
+ *  Trailing blanks of lines are dropped, soft-wrapped lines are joined without newline.
+ */
+char *select_text(screen_t *screen, size_t *length) {
+    term_select_t *select = &screen->select;
+    int width = screen->buffer_width;
+    char *text = NULL;
+    size_t capacity = 0;
+    *length = 0;
+    if (!select->active)
+        return NULL;
+    for (size_t line = select->begin.line; line <= select->end.line; line++) {
+        bool wrapped = false;
+        const uint32_t *cells = select_line(screen, line, &wrapped);
+        if (!cells)
+            continue;
+        int x_begin = line == select->begin.line ? select->begin.x : 0;
+        int x_end = line == select->end.line ? MIN(select->end.x + 1, width) : width;
+        // Spaces of wrapped line are its text, only padding left by double-width character is dropped
+        bool joined = wrapped && x_end == width && line != select->end.line;
+        while (x_end > x_begin && (cells[x_end - 1] == 0 || (!joined && cells[x_end - 1] == ' ')))
+            x_end--;
+        char chunk[READ_BUFFER_SIZE];
+        size_t n = 0;
+        for (int x = x_begin; x < x_end; x++) {
+            if (cells[x] == CELL_WIDE_TAIL)
+                continue;
+            n += (size_t) utf8_encode(cells[x] ? cells[x] : ' ', chunk + n);
+            if (n + 4 > sizeof(chunk)) {
+                if (!select_append(&text, length, &capacity, chunk, n))
+                    return NULL;
+                n = 0;
+            }
+        }
+        if (!joined && line != select->end.line)
+            chunk[n++] = '\n';
+        if (n > 0 && !select_append(&text, length, &capacity, chunk, n))
+            return NULL;
+    }
+    return text;
+}
+
+/*!
+ * \brief Free scratch rows of selection
+ */
+void select_destroy(term_select_t *select) {
+    free(select->chars);
+    free(select->attrs);
+    *select = (term_select_t) {};
+}
+
+/*!
+ * \brief Find the first match of query at cell x or after it in stored characters, returns its column or -1
+ *  Lines of one byte per character are searched with Latin-1 query, others with query cells, memmem does the
+ *  scanning in both cases. Hit across cell boundary of 4-byte characters is skipped.
+ */
+static int search_find(term_search_t *search, const char *text, int length, int char_size, int x) {
+    if (search->length == 0 || (char_size == 1 && !search->latin1))
+        return -1;
+    const char *needle = char_size == 1 ? search->query_latin1 : (const char *) search->query;
+    size_t needle_size = (size_t) search->length * (size_t) char_size;
+    size_t size = (size_t) length * (size_t) char_size;
+    size_t offset = (size_t) x * (size_t) char_size;
+    while (offset + needle_size <= size) {
+        const char *hit = memmem(text + offset, size - offset, needle, needle_size);
+        if (!hit)
+            return -1;
+        size_t position = (size_t) (hit - text);
+        if (position % (size_t) char_size == 0)
+            return (int) (position / (size_t) char_size);
+        offset = (position / (size_t) char_size + 1) * (size_t) char_size;
+    }
+    return -1;
+}
+
+/*!
+ * \brief Check that query matches at cell x of stored characters
+ */
+static bool search_match_at(term_search_t *search, const char *text, int length, int char_size, int x) {
+    if (x + search->length > length || (char_size == 1 && !search->latin1))
+        return false;
+    const char *needle = char_size == 1 ? search->query_latin1 : (const char *) search->query;
+    return !memcmp(text + (size_t) x * (size_t) char_size, needle, (size_t) search->length * (size_t) char_size);
+}
+
+/*!
+ * \brief Find the first match of query in screen row at cell x or after it, returns its column or -1
+ */
+static int search_row(screen_t *screen, int y, int x) {
+    const char *text = (const char *) screen_row(screen, y)->chars;
+    return search_find(&screen->search, text, screen->buffer_width, sizeof(uint32_t), x);
+}
+
+/*!
+ * \brief Append match of history line, evicted matches are dropped before the array grows
+ */
+static bool search_push(term_search_t *search, size_t line, int x) {
+    if (search->match_count == search->match_capacity) {
+        if (search->match_first >= search->match_count / 2 && search->match_first > 0) {
+            memmove(search->matches,
+                    search->matches + search->match_first,
+                    (search->match_count - search->match_first) * sizeof(select_point_t));
+            search->match_count -= search->match_first;
+            search->match_first = 0;
+        } else {
+            size_t capacity = search->match_capacity ? search->match_capacity * 2 : 1024;
+            select_point_t *new_matches = realloc(search->matches, capacity * sizeof(select_point_t));
+            if (!new_matches) {
+                perror("realloc");
+                return false;
+            }
+            search->matches = new_matches;
+            search->match_capacity = capacity;
+        }
+    }
+    search->matches[search->match_count++] = (select_point_t) {.line = line, .x = x};
+    return true;
+}
+
+/*!
+ * \brief Forget matches, history is scanned again from its oldest line
+ */
+static void search_reset(term_search_t *search) {
+    search->match_first = 0;
+    search->match_count = 0;
+    search->scanned = 0;
+    search->found = false;
+}
+
+/*!
+ * \brief Drop matches of lines from absolute number on, they are scanned again (reflow has replaced them)
+ */
+void search_rewind(screen_t *screen, size_t line) {
+    term_search_t *search = &screen->search;
+    while (search->match_count > search->match_first && search->matches[search->match_count - 1].line >= line)
+        search->match_count--;
+    search->scanned = MIN(search->scanned, line);
+}
+
+/*!
+ * \brief Bring matches up to date with history: drop evicted lines and scan only lines pushed since the last update
+ *  Matches may overlap, so the longer query is checked only where the shorter one matched.
+ */
+void search_update(screen_t *screen) {
+    term_search_t *search = &screen->search;
+    term_history_t *history = &screen->history;
+    size_t total = history->line_total;
+    size_t oldest = total - history->line_count;
+    while (search->match_first < search->match_count && search->matches[search->match_first].line < oldest)
+        search->match_first++;
+    // Lines taken back from history by reflow
+    search_rewind(screen, total);
+    search->scanned = MAX(search->scanned, oldest);
+    if (search->length == 0) {
+        search->scanned = total;
+        return;
+    }
+    for (; search->scanned < total; search->scanned++) {
+        int length = 0, char_size = 1;
+        const char *text = history_text(history, total - 1 - search->scanned, &length, &char_size);
+        for (int x = search_find(search, text, length, char_size, 0); x >= 0;
+             x = search_find(search, text, length, char_size, x + 1))
+            if (!search_push(search, search->scanned, x))
+                return;
+    }
+}
+
+/*!
+ * \brief Keep only matches the query still has after it grew
+ */
+static void search_filter(screen_t *screen) {
+    term_search_t *search = &screen->search;
+    term_history_t *history = &screen->history;
+    size_t kept = search->match_first;
+    for (size_t i = search->match_first; i < search->match_count; i++) {
+        select_point_t match = search->matches[i];
+        int length = 0, char_size = 1;
+        // Line gone from history has age out of range and no text
+        const char *text = history_text(history, history->line_total - 1 - match.line, &length, &char_size);
+        if (text && search_match_at(search, text, length, char_size, match.x))
+            search->matches[kept++] = match;
+    }
+    search->match_count = kept;
+    search->found = false;
+}
+
+/*!
+ * \brief Append character to query, returns false if it can't be searched (control, combining or too long query)
+ *  Longer query only filters matches of the shorter one, so typing doesn't scan history again.
+ */
+bool search_type(screen_t *screen, uint32_t c) {
+    term_search_t *search = &screen->search;
+    int width = utf8_width(c);
+    if (c < 0x20 || width == 0 || search->length + width > SEARCH_MAX)
+        return false;
+    bool grow = search->length > 0;
+    if (!grow)
+        search->latin1 = true;
+    search->query_latin1[search->length] = (char) c;
+    search->latin1 = search->latin1 && c <= 0xFF;
+    search->query[search->length++] = c;
+    if (width == 2)
+        search->query[search->length++] = CELL_WIDE_TAIL;
+    if (grow)
+        search_filter(screen);
+    else
+        search_reset(search);
+    search_update(screen);
+    return true;
+}
+
+/*!
+ * \brief Remove the last character of query, history is scanned again for the shorter one
+ */
+void search_backspace(screen_t *screen) {
+    term_search_t *search = &screen->search;
+    if (search->length == 0)
+        return;
+    search->length -= search->query[search->length - 1] == CELL_WIDE_TAIL ? 2 : 1;
+    search->latin1 = true;
+    for (int i = 0; i < search->length; i++)
+        search->latin1 = search->latin1 && search->query[i] <= 0xFF;
+    search_reset(search);
+    search_update(screen);
+}
+
+/*!
+ * \brief Find index of the first match in history at point or after it
+ */
+static size_t search_bisect(term_search_t *search, select_point_t point) {
+    size_t low = search->match_first;
+    size_t high = search->match_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (select_compare(search->matches[mid], point) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/*!
+ * \brief Scroll view so that line is visible, it's put in the middle when view has to move
+ */
+static void search_show(screen_t *screen, size_t line) {
+    size_t total = screen->history.line_total;
+    size_t top = total - screen->view_offset;
+    if (line >= top && line < top + (size_t) screen->buffer_height)
+        return;
+    long offset = line >= total ? 0 : (long) (total - line) + screen->buffer_height / 2;
+    screen_scroll_view(screen, (int) (offset - (long) screen->view_offset));
+}
+
+/*!
+ * \brief Select the next older or newer match and scroll view to it, search starts at the bottom of the screen
+ *  History of primary screen isn't searched while alternate one is shown.
+ */
+bool search_next(screen_t *screen, bool older) {
+    term_search_t *search = &screen->search;
+    if (search->length == 0)
+        return false;
+    search_update(screen);
+    size_t total = screen->history.line_total;
+    int height = screen->buffer_height;
+    select_point_t from = search->found ? search->current : (select_point_t) {.line = total + (size_t) height};
+    select_point_t match = {};
+    bool hit = false;
+    if (older) {
+        int y = from.line >= total ? (int) MIN(from.line - total, (size_t) height - 1) : -1;
+        for (; y >= 0 && !hit; y--) {
+            for (int x = search_row(screen, y, 0); x >= 0; x = search_row(screen, y, x + 1)) {
+                select_point_t point = {.line = total + (size_t) y, .x = x};
+                if (select_compare(point, from) >= 0)
+                    break;
+                match = point;
+                hit = true;
+            }
+        }
+        size_t index = search_bisect(search, from);
+        if (!hit && !screen->alternate && index > search->match_first) {
+            match = search->matches[index - 1];
+            hit = true;
+        }
+    } else {
+        size_t index = search_bisect(search, (select_point_t) {.line = from.line, .x = from.x + 1});
+        if (!screen->alternate && index < search->match_count) {
+            match = search->matches[index];
+            hit = true;
+        }
+        for (int y = from.line >= total ? (int) (from.line - total) : 0; y < height && !hit; y++) {
+            for (int x = search_row(screen, y, 0); x >= 0 && !hit; x = search_row(screen, y, x + 1)) {
+                select_point_t point = {.line = total + (size_t) y, .x = x};
+                if (select_compare(point, from) > 0) {
+                    match = point;
+                    hit = true;
+                }
+            }
+        }
+    }
+    if (!hit)
+        return false;
+    search->current = match;
+    search->found = true;
+    select_set(screen, match, (select_point_t) {.line = match.line, .x = match.x + search->length - 1});
+    search_show(screen, match.line);
+    return true;
+}
+
+/*!
+ * \brief Count matches in history and on the screen, lines pushed since the last call are scanned first
+ */
+size_t search_count(screen_t *screen) {
+    term_search_t *search = &screen->search;
+    if (search->length == 0)
+        return 0;
+    search_update(screen);
+    size_t count = screen->alternate ? 0 : search->match_count - search->match_first;
+    for (int y = 0; y < screen->buffer_height; y++)
+        for (int x = search_row(screen, y, 0); x >= 0; x = search_row(screen, y, x + 1))
+            count++;
+    return count;
+}
+
+/*!
+ * \brief Free matches of search
+ */
+void search_destroy(term_search_t *search) {
+    free(search->matches);
+    *search = (term_search_t) {};
+}
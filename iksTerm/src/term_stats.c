@@ -0,0 +1,134 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <main.h>
+#include <term_stats.h>
+
+/*!
+ * \brief Name histograms and reset them
+ */
+void stats_init(term_stats_t *stats) {
+    *stats = (term_stats_t) {
+        .latency = {.name = "key to echo us", .scale = 1e-3},
+        .read_bytes = {.name = "read bytes", .scale = 1},
+        .parse = {.name = "parse us", .scale = 1e-3},
+        .draw = {.name = "draw us", .scale = 1e-3},
+    };
+}
+
+/*!
+ * \brief Get monotonic time in nanoseconds
+ */
+uint64_t stats_now() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*!
+ * \brief Get bucket of value: small values map to themselves, then 16 buckets per power of two
+ */
+static int stats_bucket(uint64_t value) {
+    if (value < (1U << STATS_SUB_BITS))
+        return (int) value;
+    int shift = 63 - __builtin_clzll(value) - STATS_SUB_BITS;
+    return ((shift + 1) << STATS_SUB_BITS) + (int) ((value >> shift) & ((1U << STATS_SUB_BITS) - 1));
+}
+
+/*!
+ * \brief Get the highest value of bucket
+ */
+static uint64_t stats_bucket_top(int bucket) {
+    if (bucket < (1 << STATS_SUB_BITS))
+        return (uint64_t) bucket;
+    int shift = (bucket >> STATS_SUB_BITS) - 1;
+    uint64_t sub = (uint64_t) (bucket & ((1 << STATS_SUB_BITS) - 1)) + (1U << STATS_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+/*!
+ * \brief Add value to histogram
+ */
+void stats_record(stats_histogram_t *histogram, uint64_t value) {
+    histogram->counts[stats_bucket(value)]++;
+    if (histogram->count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+    histogram->count++;
+    histogram->sum += (double) value;
+}
+
+/*!
+ * \brief Get value percentile (0-100) of recorded values are below or equal to, it's exact within its bucket
+ */
+uint64_t stats_percentile(const stats_histogram_t *histogram, double percentile) {
+    if (histogram->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) histogram->count + 0.5);
+    rank = MAX(rank, 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+            return MIN(MAX(stats_bucket_top(i), histogram->min), histogram->max);
+    }
+    return histogram->max;
+}
+
+/*!
+ * \brief Note key written to PTY, keys typed before its echo is drawn belong to the same measurement
+ */
+void stats_key(term_stats_t *stats, const void *target) {
+    if (stats->key_time)
+        return;
+    stats->key_time = stats_now();
+    stats->key_target = target;
+    stats->key_echoed = false;
+}
+
+/*!
+ * \brief Record one read of PTY output parsed in elapsed ns
+ */
+void stats_output(term_stats_t *stats, const void *source, size_t bytes, uint64_t elapsed) {
+    stats_record(&stats->read_bytes, bytes);
+    stats_record(&stats->parse, elapsed);
+    if (stats->key_time && source == stats->key_target)
+        stats->key_echoed = true;
+}
+
+/*!
+ * \brief Record frame drawn in elapsed ns, it finishes latency of key whose echo it shows
+ */
+void stats_frame(term_stats_t *stats, uint64_t elapsed) {
+    stats_record(&stats->draw, elapsed);
+    if (!stats->key_echoed)
+        return;
+    stats_record(&stats->latency, stats_now() - stats->key_time);
+    stats->key_time = 0;
+    stats->key_echoed = false;
+}
+
+/*!
+ * \brief Print count, percentiles, extremes and mean of each histogram
+ */
+void stats_print(const term_stats_t *stats, FILE *file) {
+    const stats_histogram_t *histograms[] = {&stats->latency, &stats->read_bytes, &stats->parse, &stats->draw};
+    static const double percentiles[] = {50, 90, 99, 99.9};
+    fprintf(file, "%-16s %10s %10s %10s %10s %10s %10s %10s %10s\n", "", "count", "min", "p50", "p90", "p99", "p99.9",
+            "max", "mean");
+    for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++) {
+        const stats_histogram_t *histogram = histograms[i];
+        double scale = histogram->scale;
+        fprintf(file, "%-16s %10lu %10.1f", histogram->name, (unsigned long) histogram->count,
+                (double) histogram->min * scale);
+        for (size_t j = 0; j < sizeof(percentiles) / sizeof(percentiles[0]); j++)
+            fprintf(file, " %10.1f", (double) stats_percentile(histogram, percentiles[j]) * scale);
+        fprintf(file, " %10.1f %10.1f\n", (double) histogram->max * scale,
+                histogram->count ? histogram->sum / (double) histogram->count * scale : 0.0);
+    }
+    fflush(file);
+}
@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <main.h>
+#include <term_utf8.h>
+
+/*!
+ * @struct utf8_range_t
+ * @brief Inclusive range of codepoints
+ */
+typedef struct utf8_range_t {
+    uint32_t first;///< First codepoint
+    uint32_t last; ///< Last codepoint
+} utf8_range_t;
+
+/*!
+ * @brief Combining marks and format characters, they take no cell
+ */
+static const utf8_range_t utf8_zero_width[] = {
+    {0x0300, 0x036F},   {0x0483, 0x0489},   {0x0591, 0x05BD},   {0x05BF, 0x05BF},   {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5},   {0x05C7, 0x05C7},   {0x0610, 0x061A},   {0x064B, 0x065F},   {0x0670, 0x0670},
+    {0x06D6, 0x06DC},   {0x06DF, 0x06E4},   {0x06E7, 0x06E8},   {0x06EA, 0x06ED},   {0x0E31, 0x0E31},
+    {0x0E34, 0x0E3A},   {0x0E47, 0x0E4E},   {0x1AB0, 0x1AFF},   {0x1DC0, 0x1DFF},   {0x200B, 0x200F},
+    {0x202A, 0x202E},   {0x2060, 0x2064},   {0x20D0, 0x20FF},   {0xFE00, 0xFE0F},   {0xFE20, 0xFE2F},
+    {0xFEFF, 0xFEFF},   {0xE0100, 0xE01EF},
+};
+
+/*!
+ * @brief East Asian wide and fullwidth characters and emoji, they take two cells
+ */
+static const utf8_range_t utf8_double_width[] = {
+    {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},   {0x23E9, 0x23EC},   {0x23F0, 0x23F0},
+    {0x23F3, 0x23F3},   {0x25FD, 0x25FE},   {0x2614, 0x2615},   {0x2648, 0x2653},   {0x267F, 0x267F},
+    {0x2693, 0x2693},   {0x26A1, 0x26A1},   {0x26AA, 0x26AB},   {0x26BD, 0x26BE},   {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE},   {0x26D4, 0x26D4},   {0x26EA, 0x26EA},   {0x26F2, 0x26F3},   {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA},   {0x26FD, 0x26FD},   {0x2705, 0x2705},   {0x270A, 0x270B},   {0x2728, 0x2728},
+    {0x274C, 0x274C},   {0x274E, 0x274E},   {0x2753, 0x2755},   {0x2757, 0x2757},   {0x2795, 0x2797},
+    {0x27B0, 0x27B0},   {0x27BF, 0x27BF},   {0x2B1B, 0x2B1C},   {0x2B50, 0x2B50},   {0x2B55, 0x2B55},
+    {0x2E80, 0x303E},   {0x3041, 0x33FF},   {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},   {0xA000, 0xA4CF},
+    {0xA960, 0xA97F},   {0xAC00, 0xD7A3},   {0xF900, 0xFAFF},   {0xFE10, 0xFE19},   {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E},
+    {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F900, 0x1F9FF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+/*!
+ * \brief Binary search of codepoint in sorted ranges
+ */
+static bool utf8_in_ranges(uint32_t c, const utf8_range_t *ranges, size_t count) {
+    if (c < ranges[0].first || c > ranges[count - 1].last)
+        return false;
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (c > ranges[mid].last)
+            low = mid + 1;
+        else if (c < ranges[mid].first)
+            high = mid;
+        else
+            return true;
+    }
+    return false;
+}
+
+/*!
+ * \brief Get number of cells taken by codepoint (wcwidth)
+ *  Table is built in, so result doesn't depend on locale of the terminal process
+ */
+int utf8_width(uint32_t c) {
+    // Latin-1 and Latin Extended never reach the tables
+    if (c < 0x300)
+        return (c >= 0x7F && c < 0xA0) ? 0 : 1;
+    if (utf8_in_ranges(c, utf8_zero_width, sizeof(utf8_zero_width) / sizeof(utf8_zero_width[0])))
+        return 0;
+    if (utf8_in_ranges(c, utf8_double_width, sizeof(utf8_double_width) / sizeof(utf8_double_width[0])))
+        return 2;
+    return 1;
+}
+
+/*!
+ * \brief Encode codepoint into out (4 bytes at most), returns number of bytes
+ */
+int utf8_encode(uint32_t c, char *out) {
+    if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+        c = UTF8_REPLACEMENT;
+    if (c < 0x80) {
+        out[0] = (char) c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (char) (0xC0 | (c >> 6));
+        out[1] = (char) (0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (char) (0xE0 | (c >> 12));
+        out[1] = (char) (0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (c >> 18));
+    out[1] = (char) (0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (c & 0x3F));
+    return 4;
+}
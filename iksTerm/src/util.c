@@ -1,9 +1,12 @@
 #include <ctype.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/stat.h>
@@ -11,6 +14,15 @@
 #include <X11/Xutil.h>
 
 #include <main.h>
+#include <term_color.h>
+#include <term_history.h>
+#include <term_utf8.h>
+#include <term_parser.h>
+#include <term_select.h>
+#include <term_screen.h>
+#include <term_ring.h>
+#include <term_record.h>
+#include <term_stats.h>
 #include <term.h>
 #include <term_pty.h>
 #include <util.h>
@@ -19,6 +31,11 @@
  * \brief Get and process options
  */
 void get_options(term_t *term, pty_t *pty, int argc, char **argv) {
+    // Defaults where zero is a valid value
+    term->frame_rate = DEFAULT_FRAME_RATE;
+    term->blink_rate = DEFAULT_BLINK_RATE;
+    term->history_size = HISTORY_SIZE;
+    pty->replay_speed = 1.0;
     // Scan options
     int c;
     while (true) {
@@ -30,11 +47,20 @@ void get_options(term_t *term, pty_t *pty, int argc, char **argv) {
                                                {"cursor", required_argument, 0, 'c'},
                                                {"shell", required_argument, 0, 's'},
                                                {"font", required_argument, 0, 'o'},
+                                               {"stats", no_argument, 0, 'S'},
+                                               {"rate", required_argument, 0, 'r'},
+                                               {"history", required_argument, 0, 'H'},
+                                               {"thread", no_argument, 0, 'T'},
+                                               {"blink", required_argument, 0, 'B'},
+                                               {"record", required_argument, 0, 'R'},
+                                               {"replay", required_argument, 0, 'P'},
+                                               {"speed", required_argument, 0, 'x'},
+                                               {"max", no_argument, 0, 'M'},
                                                {0, 0, 0, 0}};
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "hw:l:s:o:f:b:c:", long_options, &option_index);
+        c = getopt_long(argc, argv, "hw:l:s:o:f:b:c:Sr:H:TB:R:P:x:M", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -59,12 +85,12 @@ void get_options(term_t *term, pty_t *pty, int argc, char **argv) {
             case 'w': {
                 int custom_width = atoi(optarg);
                 if (custom_width > 0)
-                    term->buffer_width = (int) custom_width;
+                    term->option_width = (int) custom_width;
             } break;
             case 'l': {
                 int custom_height = atoi(optarg);
                 if (custom_height > 0)
-                    term->buffer_height = (int) custom_height;
+                    term->option_height = (int) custom_height;
             } break;
             case 'f': {
                 char *custom_hex_color = optarg;
@@ -105,6 +131,45 @@ void get_options(term_t *term, pty_t *pty, int argc, char **argv) {
             case 'o':
                 term->font_name = optarg;
                 break;
+            case 'S':
+                term->print_stats = true;
+                stats_init(&term->stats);
+                pty->stats = &term->stats;
+                break;
+            case 'r': {
+                int custom_rate = atoi(optarg);
+                if (custom_rate >= 0)
+                    term->frame_rate = custom_rate;
+            } break;
+            case 'H': {
+                int custom_history = atoi(optarg);
+                if (custom_history >= 0)
+                    term->history_size = custom_history;
+            } break;
+            case 'T':
+                pty->threaded = true;
+                break;
+            case 'B': {
+                int custom_blink = atoi(optarg);
+                if (custom_blink >= 0)
+                    term->blink_rate = custom_blink;
+            } break;
+            case 'R':
+                pty->record_path = optarg;
+                break;
+            case 'P':
+                pty->replay_path = optarg;
+                break;
+            case 'x': {
+                double custom_speed = atof(optarg);
+                if (custom_speed > 0)
+                    pty->replay_speed = custom_speed;
+                else
+                    fprintf(stderr, "Invalid replay speed \"%s\". Switch to default 1\n", optarg);
+            } break;
+            case 'M':
+                pty->replay_speed = 0;
+                break;
 
             case '?':
                 /* getopt_long already printed an error message. */
@@ -143,6 +208,17 @@ void print_help() {
             "Setup common terminal things:\n"
             "   -sPATH, --shell=PATH                Set path to shell that launched in terminal. Default is \"/bin/sh\".\n"
             "   -oNAME, --font=NAME                 Set font from X11 by name, use `xlsfonts` to list. Default is \"fixed\".\n"
+            "   -S, --stats                         Print rendering statistics and latency histograms at exit and on SIGUSR1.\n"
+            "   -rNUM, --rate=NUM                   Set maximum frames per second during output, 0 is unlimited. Default is 60.\n"
+            "   -HNUM, --history=NUM                Set scrollback memory limit in KiB, Shift+PgUp/PgDn to scroll. Default is 4096.\n"
+            "   -BNUM, --blink=NUM                  Set cursor blink half-period in ms, 0 disables it. Default is 500.\n"
+            "   -T, --thread                        Read PTY in separate thread, so slow X server doesn't stall the shell.\n"
+            "\n"
+            "Record and replay shell output:\n"
+            "   -RFILE, --record=FILE               Record output of the first shell with timestamps to FILE.\n"
+            "   -PFILE, --replay=FILE               Replay recorded FILE instead of starting shell.\n"
+            "   -xNUM, --speed=NUM                  Replay NUM times faster than recorded. Default is 1.\n"
+            "   -M, --max                           Replay as fast as possible, print throughput and exit.\n"
             "\n"
             "Examples:\n"
             "   $ iksTerm --width=100 -s/bin/bash -c\"#aaa000\"         # Set custom width,shell,and cursor's color\n"
@@ -171,4 +247,13 @@ bool is_valid_hex_color(const char *str) {
     }
 
     return true;
+}
+
+/*!
+ * \brief Get monotonic time in microseconds
+ */
+unsigned long time_now_us() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ts.tv_sec * 1000000UL + (unsigned long) ts.tv_nsec / 1000UL;
 }
\ No newline at end of file
@@ -0,0 +1,134 @@
+// Benchmark of process launch: commands per second for `true` and for pipelines of `true`,
+// started by posix_spawnp, by posix_spawn with path cached by `hash` table and by fork.
+// Then tokens per second of splitting a generated script, by the tokenizer and by the former
+// std::stringstream splitting. Built with the same sanitizers as paraShell, so the cost
+// of duplicating its address space is included.
+//
+// Usage: paraShellBench [COMMANDS [STAGES [BALLAST_MIB [SCRIPT_LINES]]]]
+//   COMMANDS      number of commands started in each run (default 2000)
+//   STAGES        stages of measured pipeline (default 8)
+//   BALLAST_MIB   touched heap added to the parent, like a shell with large history (default 0)
+//   SCRIPT_LINES  lines of script split by tokenizers (default 200000)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../command_hash.hpp"
+#include "../pipeline.hpp"
+#include "../tokenizer.hpp"
+
+static double measure(Pipeline::Mode mode, PathResolver *resolver, size_t commands, size_t stages) {
+    static char name[] = "true";
+    std::vector<std::vector<char *>> argv(stages, std::vector<char *> {name, nullptr});
+    Pipeline pipeline(mode, resolver);
+
+    size_t started = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (; started < commands; started += stages) {
+        if (pipeline.run(argv.data(), argv.size()) != Pipeline::RESULT_OK) {
+            std::fprintf(stderr, "pipeline failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    return (double) started / elapsed.count();
+}
+
+// Lines with pipes, quotes and options, like a build script
+static std::vector<std::string> makeScript(size_t lines) {
+    std::vector<std::string> script(lines);
+    for (size_t lineNumber = 0; lineNumber < lines; ++lineNumber) {
+        std::string &line = script[lineNumber];
+        line = "gcc -O2 -Wall -c src/file" + std::to_string(lineNumber) + ".c -o build/file" +
+               std::to_string(lineNumber) + ".o";
+        if (lineNumber % 3 == 0)
+            line += " | grep -v 'note: ' | tee -a \"build log.txt\"";
+        if (lineNumber % 5 == 0)
+            line += " | sort | uniq -c | head -n 20";
+    }
+    return script;
+}
+
+// Former splitting: stringstream, copy of every word and new argument lists for each line
+static size_t splitStream(const std::string &line, std::vector<std::string> &words,
+                          std::vector<std::vector<char *>> &argv) {
+    words.clear();
+    argv.clear();
+    std::stringstream ss(line);
+    std::string word;
+    while (ss >> word)
+        words.push_back(std::move(word));
+
+    argv.emplace_back();
+    for (auto &string : words) {
+        if (string == "|") {
+            argv.back().push_back(nullptr);
+            argv.emplace_back();
+        } else {
+            argv.back().push_back(&string[0]);
+        }
+    }
+    argv.back().push_back(nullptr);
+    return words.size();
+}
+
+static void measureSplit(size_t lines) {
+    std::vector<std::string> script = makeScript(lines);
+    std::vector<std::string> copies = script;
+
+    std::vector<std::string> words;
+    std::vector<std::vector<char *>> argv;
+    size_t streamTokens = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto &line : script)
+        streamTokens += splitStream(line, words, argv);
+    std::chrono::duration<double> streamElapsed = std::chrono::steady_clock::now() - begin;
+
+    // Lines are split in place, like the line buffer of the shell
+    Tokenizer tokenizer;
+    size_t tokens = 0;
+    begin = std::chrono::steady_clock::now();
+    for (auto &line : copies) {
+        tokenizer.split(&line[0], line.size());
+        tokens += tokenizer.tokenCount();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::printf("\n%-12s %10s %10s %14s\n", "split", "lines", "tokens", "Mtokens/s");
+    std::printf("%-12s %10zu %10zu %14.2f\n", "stringstream", lines, streamTokens,
+                (double) streamTokens / streamElapsed.count() / 1e6);
+    std::printf("%-12s %10zu %10zu %14.2f\n", "tokenizer", lines, tokens, (double) tokens / elapsed.count() / 1e6);
+}
+
+int main(int argc, char **argv) {
+    size_t commands = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    size_t stages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+    size_t ballastMib = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0;
+    size_t scriptLines = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 200000;
+    if (commands == 0 || stages == 0) {
+        std::fprintf(stderr, "Usage: %s [COMMANDS [STAGES [BALLAST_MIB [SCRIPT_LINES]]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<char> ballast(ballastMib << 20, 1);
+
+    CommandHash commandHash;
+    std::printf("%-10s %14s %20s\n", "mode", "true cmd/s", (std::to_string(stages) + "-stage cmd/s").c_str());
+    const Pipeline::Mode modes[] = {Pipeline::MODE_SPAWN, Pipeline::MODE_SPAWN, Pipeline::MODE_FORK};
+    PathResolver *resolvers[] = {nullptr, &commandHash, nullptr};
+    const char *names[] = {"spawnp", "spawn+hash", "fork"};
+    for (size_t modeNumber = 0; modeNumber < 3; ++modeNumber) {
+        double single = measure(modes[modeNumber], resolvers[modeNumber], commands, 1);
+        double pipeline = measure(modes[modeNumber], resolvers[modeNumber], commands, stages);
+        std::printf("%-10s %14.0f %20.0f\n", names[modeNumber], single, pipeline);
+    }
+
+    measureSplit(scriptLines);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+
+// Compile-time perfect hash of builtin names: every builtin has its own slot of the table,
+// so a lookup is one hash of a few characters and one strcmp instead of a scan of all names.
+namespace builtin {
+
+// Number of slots, it's larger than number of builtins to leave room for perfect placement
+constexpr unsigned TABLE_SIZE = 16;
+// Only so many first characters are hashed, long words are rejected by strcmp
+constexpr unsigned HASHED_CHARS = 16;
+
+constexpr unsigned hash(const char *name, unsigned value = 5381, unsigned depth = 0) {
+    return (*name && depth < HASHED_CHARS) ? hash(name + 1, (value * 31) ^ (unsigned char) *name, depth + 1) : value;
+}
+
+constexpr unsigned slot(const char *name) {
+    return hash(name) % TABLE_SIZE;
+}
+
+// Index of command placed in slot, 0 for empty slot; entry 0 of commands is "no command"
+template <typename Info>
+constexpr size_t find(const Info *commands, size_t count, unsigned slotNumber, size_t index = 1) {
+    return index == count ? 0
+                          : (slot(commands[index].name) == slotNumber ? index
+                                                                      : find(commands, count, slotNumber, index + 1));
+}
+
+// Command index of every slot, generated for all TABLE_SIZE slots
+struct Slots {
+    size_t index[TABLE_SIZE];
+};
+
+template <size_t... Slot>
+struct SlotSequence {};
+
+template <size_t Count, size_t... Slot>
+struct MakeSlotSequence : MakeSlotSequence<Count - 1, Count - 1, Slot...> {};
+
+template <size_t... Slot>
+struct MakeSlotSequence<0, Slot...> {
+    typedef SlotSequence<Slot...> type;
+};
+
+template <typename Info, size_t... Slot>
+constexpr Slots slots(const Info *commands, size_t count, SlotSequence<Slot...>) {
+    return Slots {{find(commands, count, Slot)...}};
+}
+
+template <typename Info>
+constexpr Slots slots(const Info *commands, size_t count) {
+    return slots(commands, count, typename MakeSlotSequence<TABLE_SIZE>::type());
+}
+
+// Every command is found in its slot and is numbered by its index
+template <typename Info>
+constexpr bool perfect(const Info *commands, size_t count, size_t index = 1) {
+    return index == count || ((size_t) commands[index].commandNum == index &&
+                              find(commands, count, slot(commands[index].name)) == index &&
+                              perfect(commands, count, index + 1));
+}
+
+}// namespace builtin
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "pipeline.hpp"
+
+// Cache of PATH lookups like `hash` of bash: command name -> absolute path, filled lazily.
+// The whole table is dropped when PATH changes, one entry when its file is gone (ENOENT on spawn).
+// Relative entries of PATH (`.` or empty) depend on the current directory: a command found in one of them,
+// or after one of them was walked, isn't remembered and is looked up again on the next run.
+class CommandHash : public PathResolver {
+   public:
+    const char *resolve(const char *name) override {
+        // Names with slash are run as they are, without PATH walk
+        if (strchr(name, '/'))
+            return nullptr;
+
+        const char *path = getenv("PATH");
+        if (!path)
+            path = DEFAULT_PATH;
+        if (pathValue != path) {
+            entries.clear();
+            pathValue = path;
+        }
+
+        auto found = entries.find(name);
+        if (found != entries.end()) {
+            ++found->second.hits;
+            return found->second.path.c_str();
+        }
+
+        std::string resolved;
+        bool absolute = true;
+        if (!search(name, resolved, absolute))
+            return nullptr;
+        if (!absolute) {
+            uncached = std::move(resolved);
+            return uncached.c_str();
+        }
+
+        Entry &entry = entries[name];
+        entry.path = std::move(resolved);
+        entry.hits = 1;
+        return entry.path.c_str();
+    }
+
+    void forget(const char *name) override {
+        entries.erase(name);
+    }
+
+    void clear() {
+        entries.clear();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    void print(std::ostream &out) const {
+        out << "hits\tcommand\n";
+        for (const auto &entry : entries)
+            out << "   " << entry.second.hits << "\t" << entry.second.path << "\n";
+        // Commands started later write to the same descriptor directly
+        out.flush();
+    }
+
+   private:
+    // Search path of execvp when PATH isn't set
+    constexpr static const char *DEFAULT_PATH = "/bin:/usr/bin";
+
+    struct Entry {
+        std::string path;
+        size_t hits = 0;
+    };
+
+    std::string pathValue;
+    // Last path that can't be remembered, valid until the next resolve
+    std::string uncached;
+    std::unordered_map<std::string, Entry> entries;
+
+    // Walk PATH like execvp does, empty entry is the current directory.
+    // `absolute` is cleared when a relative entry was walked, up to the match or to the end.
+    bool search(const char *name, std::string &resolved, bool &absolute) const {
+        const char *begin = pathValue.c_str();
+        while (true) {
+            const char *end = strchr(begin, ':');
+            size_t length = end ? (size_t) (end - begin) : strlen(begin);
+
+            resolved.assign(begin, length);
+            if (resolved.empty())
+                resolved = ".";
+            if (resolved[0] != '/')
+                absolute = false;
+            resolved.append("/").append(name);
+
+            struct stat info;
+            if (stat(resolved.c_str(), &info) == 0 && S_ISREG(info.st_mode) && access(resolved.c_str(), X_OK) == 0)
+                return true;
+
+            if (!end)
+                return false;
+            begin = end + 1;
+        }
+    }
+};
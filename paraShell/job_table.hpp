@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cerrno>
+#include <poll.h>
+#include <string>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// Jobs started without waiting for them. Every stage is watched by a pidfd, so one poll() over all running
+// stages finds the ones that ended, instead of blocking waitpid() on them in order. Only own pids are waited,
+// so the foreground pipeline and other tables never reap each other's children.
+class JobTable {
+   public:
+    struct Job {
+        size_t number;
+        std::string command;
+        std::vector<pid_t> pids;// Stages not reaped yet
+        std::vector<int> pidfds;// pidfd of each of them, -1 when the kernel has no pidfd_open
+        bool failed = false;    // Some stage exited with non-zero status or by signal
+    };
+
+    JobTable() = default;
+    JobTable(const JobTable &) = delete;
+    JobTable &operator=(const JobTable &) = delete;
+
+    // Children still running are left to init, like sh does at exit
+    ~JobTable() {
+        for (const Job &job : jobs)
+            for (int pidfd : job.pidfds)
+                if (pidfd != -1)
+                    close(pidfd);
+    }
+
+    // Watch started stages of pipeline as one job, numbered after the last running one
+    size_t add(std::string command, const std::vector<pid_t> &pids) {
+        jobs.emplace_back();
+        Job &job = jobs.back();
+        job.number = jobs.size() == 1 ? 1 : jobs[jobs.size() - 2].number + 1;
+        job.command = std::move(command);
+        job.pids = pids;
+        // pidfd is close-on-exec, so it isn't inherited by commands started later
+        for (pid_t pid : pids)
+            job.pidfds.push_back((int) syscall(SYS_pidfd_open, pid, 0));
+        return job.number;
+    }
+
+    size_t size() const {
+        return jobs.size();
+    }
+
+    // Running jobs in order of their numbers
+    const std::vector<Job> &running() const {
+        return jobs;
+    }
+
+    bool contains(size_t number) const {
+        for (const Job &job : jobs)
+            if (job.number == number)
+                return true;
+        return false;
+    }
+
+    // Reap ended stages, finished jobs are passed to `done` and dropped.
+    // With `block` it waits until a job finishes, unless none is running.
+    template <typename Done>
+    void reap(bool block, Done done) {
+        bool finished = false;
+        do {
+            bool untracked = false;
+            pollfds.clear();
+            for (const Job &job : jobs) {
+                for (int pidfd : job.pidfds) {
+                    if (pidfd != -1)
+                        pollfds.push_back({pidfd, POLLIN, 0});
+                    else
+                        untracked = true;
+                }
+            }
+
+            // Stages without pidfd are checked every 10 ms
+            int timeout = !block || jobs.empty() ? 0 : (untracked ? 10 : -1);
+            if (poll(pollfds.data(), pollfds.size(), timeout) < 0 && errno != EINTR)
+                return;
+
+            // Stages are visited in the order their pidfds were polled
+            size_t polled = 0;
+            for (size_t index = 0; index < jobs.size();) {
+                Job &job = jobs[index];
+                size_t kept = 0;
+                for (size_t stage = 0; stage < job.pids.size(); ++stage) {
+                    bool ready = job.pidfds[stage] == -1 || pollfds[polled++].revents;
+                    if (ready && reaped(job, stage))
+                        continue;
+                    job.pids[kept] = job.pids[stage];
+                    job.pidfds[kept++] = job.pidfds[stage];
+                }
+                job.pids.resize(kept);
+                job.pidfds.resize(kept);
+
+                if (job.pids.empty()) {
+                    done(job);
+                    jobs.erase(jobs.begin() + (std::ptrdiff_t) index);
+                    finished = true;
+                } else {
+                    ++index;
+                }
+            }
+        } while (block && !finished && !jobs.empty());
+    }
+
+   private:
+    std::vector<Job> jobs;
+    std::vector<pollfd> pollfds;
+
+    static bool reaped(Job &job, size_t stage) {
+        int status = 0;
+        pid_t pid = waitpid(job.pids[stage], &status, WNOHANG);
+        // ECHILD: stage was reaped elsewhere, it's done anyway
+        if (pid == 0 || (pid < 0 && errno != ECHILD))
+            return false;
+
+        if (status)
+            job.failed = true;
+        if (job.pidfds[stage] != -1)
+            close(job.pidfds[stage]);
+        return true;
+    }
+};
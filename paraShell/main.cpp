@@ -1,13 +1,72 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
 #include "shell.hpp"
 
-int main() {
+// Whole script is read at once, it's followed by '\0' for the tokenizer
+static bool readScript(const char *path, std::vector<char> &script) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    // One byte more than the file to see its end without growing, one for '\0'
+    struct stat info;
+    size_t capacity = fstat(fd, &info) == 0 && info.st_size > 0 ? (size_t) info.st_size + 2 : 4096;
+    script.resize(capacity);
+
+    size_t length = 0;
+    ssize_t count = 0;
+    do {
+        if (length + 1 == script.size())
+            script.resize(script.size() * 2);
+        count = read(fd, script.data() + length, script.size() - length - 1);
+        if (count > 0)
+            length += (size_t) count;
+    } while (count > 0 || (count < 0 && errno == EINTR));
+
+    int error = errno;
+    close(fd);
+    errno = error;
+
+    script.resize(length + 1);
+    script[length] = '\0';
+    return count == 0;
+}
+
+// paraShell               read commands from standard input, prompt is shown on terminal
+// paraShell SCRIPT        run script file
+// paraShell -c COMMANDS   run commands of the argument
+int main(int argc, char **argv) {
     try {
         Shell shell;
+        if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+            if (argc < 3) {
+                std::cerr << "Usage: " << argv[0] << " [-c COMMANDS | SCRIPT]" << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::vector<char> script(argv[2], argv[2] + strlen(argv[2]) + 1);
+            return shell.executeScript("-c", script.data(), script.size() - 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (argc > 1) {
+            std::vector<char> script;
+            if (!readScript(argv[1], script)) {
+                std::cerr << argv[1] << ": " << strerror(errno) << std::endl;
+                return EXIT_FAILURE;
+            }
+            return shell.executeScript(argv[1], script.data(), script.size() - 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        bool interactive = isatty(STDIN_FILENO);
         do {
-            std::cerr << "> ";
-            shell.execute();
-        } while (true);
+            if (interactive)
+                std::cerr << "> ";
+        } while (shell.execute());
     } catch (std::exception &e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cerrno>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+// Finds executable of command, so stages are started without walking PATH
+class PathResolver {
+   public:
+    // Absolute path of command, nullptr leaves the search to posix_spawnp
+    virtual const char *resolve(const char *name) = 0;
+    // Resolved path turned out to be stale
+    virtual void forget(const char *name) = 0;
+};
+
+// Starts stages of pipeline connected by pipes and waits for them.
+// Stages are started by posix_spawnp: glibc runs it with clone(CLONE_VM | CLONE_VFORK), so the parent image
+// (large with sanitizers) isn't duplicated for every command. fork() is kept as fallback.
+class Pipeline {
+   public:
+    enum Mode { MODE_SPAWN = 0, MODE_FORK = 1 };
+
+    enum Result { RESULT_OK = 0, RESULT_PIPE = 1, RESULT_START = 2, RESULT_NOT_FOUND = 3, RESULT_STATUS = 4 };
+
+    explicit Pipeline(Mode mode = MODE_SPAWN, PathResolver *resolver = nullptr) : mode(mode), resolver(resolver) {}
+
+    // argv points to `stages` null-terminated argument lists, one per stage
+    Result run(std::vector<char *> *argv, size_t stages) {
+        pids.clear();
+        Result result = start(argv, stages, pids);
+
+        // All started stages are reaped, even when a later one failed to start
+        for (pid_t pid : pids) {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            if (status && result == RESULT_OK)
+                result = RESULT_STATUS;
+        }
+
+        return result;
+    }
+
+    // Starts stages without waiting for them, their pids are appended to `started`.
+    // Stages started before a failure are left running and must be waited by the caller too.
+    Result start(std::vector<char *> *argv, size_t stages, std::vector<pid_t> &started) {
+        Result result = RESULT_OK;
+
+        // Only the pipe to the next stage is open at once, its ends are close-on-exec and dup2 clears the flag
+        int fdIn = -1;
+        for (size_t stage = 0; stage < stages && result == RESULT_OK; ++stage) {
+            int channel[2] = {-1, -1};
+            if (stage + 1 < stages && pipe2(channel, O_CLOEXEC) < 0) {
+                result = RESULT_PIPE;
+                break;
+            }
+
+            pid_t pid = startStage(argv[stage].data(), fdIn, channel[1], result);
+            if (pid > 0)
+                started.push_back(pid);
+
+            if (fdIn != -1)
+                close(fdIn);
+            if (channel[1] != -1)
+                close(channel[1]);
+            fdIn = channel[0];
+        }
+
+        if (fdIn != -1)
+            close(fdIn);
+
+        return result;
+    }
+
+   private:
+    Mode mode;
+    PathResolver *resolver;
+    std::vector<pid_t> pids;
+
+    // Errors of command itself, other failures of posix_spawnp are retried with fork
+    static bool commandError(int error) {
+        return error == ENOENT || error == EACCES || error == ENOEXEC || error == ENOTDIR || error == ELOOP ||
+               error == ENAMETOOLONG || error == E2BIG;
+    }
+
+    pid_t startStage(char *const argv[], int fdIn, int fdOut, Result &result) {
+        // Empty stage, e.g. `a | | b`
+        if (!argv[0]) {
+            result = RESULT_NOT_FOUND;
+            return -1;
+        }
+
+        const char *path = resolver ? resolver->resolve(argv[0]) : nullptr;
+        if (mode == MODE_SPAWN) {
+            pid_t pid = 0;
+            int error = startSpawn(path, argv, fdIn, fdOut, pid);
+            // Cached file was removed, PATH is walked again once
+            if (error == ENOENT && path) {
+                resolver->forget(argv[0]);
+                path = resolver->resolve(argv[0]);
+                error = startSpawn(path, argv, fdIn, fdOut, pid);
+            }
+            if (!error)
+                return pid;
+            if (commandError(error)) {
+                result = RESULT_NOT_FOUND;
+                return -1;
+            }
+        }
+
+        pid_t pid = startFork(path, argv, fdIn, fdOut);
+        if (pid < 0)
+            result = RESULT_START;
+        return pid;
+    }
+
+    // Path is exact when given, otherwise command is searched in PATH
+    static int startSpawn(const char *path, char *const argv[], int fdIn, int fdOut, pid_t &pid) {
+        posix_spawn_file_actions_t actions;
+        if (int error = posix_spawn_file_actions_init(&actions))
+            return error;
+
+        int error = 0;
+        if (fdIn != -1)
+            error = posix_spawn_file_actions_adddup2(&actions, fdIn, STDIN_FILENO);
+        if (!error && fdOut != -1)
+            error = posix_spawn_file_actions_adddup2(&actions, fdOut, STDOUT_FILENO);
+        if (!error && path)
+            error = posix_spawn(&pid, path, &actions, nullptr, argv, environ);
+        else if (!error)
+            error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv, environ);
+
+        posix_spawn_file_actions_destroy(&actions);
+        return error;
+    }
+
+    static pid_t startFork(const char *path, char *const argv[], int fdIn, int fdOut) {
+        pid_t pid = fork();
+        if (pid != 0)
+            return pid;
+
+        if (fdIn != -1)
+            dup2(fdIn, STDIN_FILENO);
+        if (fdOut != -1)
+            dup2(fdOut, STDOUT_FILENO);
+
+        if (path)
+            execv(path, argv);
+        else
+            execvp(argv[0], argv);
+        // Child must never return into the loop of the shell
+        _exit(127);
+    }
+};
@@ -2,12 +2,17 @@
 
 #include <cstring>
 #include <memory>
-#include <sstream>
 #include <string>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
+#include "builtin_table.hpp"
+#include "command_hash.hpp"
+#include "job_table.hpp"
+#include "pipeline.hpp"
+#include "tokenizer.hpp"
+
 class Shell {
     enum ShellError {
         ERROR_OK = 0,
@@ -16,7 +21,13 @@ class Shell {
         ERROR_STATUS_CHILD = 3,
         ERROR_CHANGE_DIR = 4,
         ERROR_MOVE_HOME = 5,
-        ERROR_FORK = 6
+        ERROR_FORK = 6,
+        ERROR_PIPE = 7,
+        ERROR_HASH_NOT_FOUND = 8,
+        ERROR_UNTERMINATED_QUOTE = 9,
+        ERROR_EMPTY_STAGE = 10,
+        ERROR_NO_JOB = 11,
+        ERROR_PARALLEL_USAGE = 12
     };
 
     const char *get_error_msg(ShellError error) {
@@ -35,26 +46,64 @@ class Shell {
                 return "Error cd without args (move to home directory).";
             case ERROR_FORK:
                 return "Fork error.";
+            case ERROR_PIPE:
+                return "Pipe error.";
+            case ERROR_HASH_NOT_FOUND:
+                return "Hash: some commands not found in PATH.";
+            case ERROR_UNTERMINATED_QUOTE:
+                return "Unterminated quote.";
+            case ERROR_EMPTY_STAGE:
+                return "Syntax error: empty command near | or &.";
+            case ERROR_NO_JOB:
+                return "Wait: no such job.";
+            case ERROR_PARALLEL_USAGE:
+                return "Usage: parallel [-j N] COMMAND [ARGS...] ::: VALUE...";
             default:
                 return "Unknow error type.";
         }
     }
 
-    void print_error(ShellError error) {
-        std::cerr << currentLine << " :( ERROR: " << get_error_msg(error) << std::endl;
+    // Line is split in place, its copy taken before is shown
+    void print_error(const std::string &line, ShellError error) {
+        std::cerr << line << " :( ERROR: " << get_error_msg(error) << std::endl;
+    }
+
+    static ShellError pipelineError(Pipeline::Result result) {
+        switch (result) {
+            case Pipeline::RESULT_OK:
+                return ERROR_OK;
+            case Pipeline::RESULT_PIPE:
+                return ERROR_PIPE;
+            case Pipeline::RESULT_START:
+                return ERROR_FORK;
+            case Pipeline::RESULT_NOT_FOUND:
+                return ERROR_EXEC_CHILD;
+            default:
+                return ERROR_STATUS_CHILD;
+        }
+    }
+
+    static void reportJob(const JobTable::Job &job) {
+        std::cerr << "[" << job.number << "] " << (job.failed ? "Failed " : "Done ") << job.command << std::endl;
     }
 
-    enum CommandNumber { NONE = 0, CD = 1, EXIT = 2, NUMBER_COMMANDS };
+    enum CommandNumber { NONE = 0, CD = 1, EXIT = 2, HASH = 3, WAIT = 4, JOBS = 5, PARALLEL = 6, NUMBER_COMMANDS };
 
     struct CommandInfo {
         CommandNumber commandNum;
         const char *name;
     };
 
-    constexpr static CommandInfo COMMANDS[NUMBER_COMMANDS] {{NONE}, {CD, "cd"}, {EXIT, "exit"}};
+    constexpr static CommandInfo COMMANDS[NUMBER_COMMANDS] {{NONE, ""},     {CD, "cd"},     {EXIT, "exit"},        {HASH, "hash"},
+                                                          {WAIT, "wait"}, {JOBS, "jobs"}, {PARALLEL, "parallel"}};
+
+    static_assert(builtin::perfect(COMMANDS, NUMBER_COMMANDS), "Builtin names collide, change builtin::hash");
+
+    constexpr static builtin::Slots BUILTIN_SLOTS = builtin::slots(COMMANDS, NUMBER_COMMANDS);
 
     class InternalCommand {
        public:
+        virtual ~InternalCommand() = default;
         virtual ShellError execute(const std::vector<char *> &argv) = 0;
     };
 
@@ -81,17 +130,230 @@ class Shell {
         }
     };
 
-    std::string currentLine;
-    std::vector<std::string> words;
-    size_t numberPrograms = 0;
-    std::vector<std::vector<char *>> argv;
+    // hash            list cached commands
+    // hash -r         forget all of them
+    // hash -d NAME... forget the named ones
+    // hash NAME...    look them up in PATH and remember
+    class HashCommand : public InternalCommand {
+       public:
+        explicit HashCommand(CommandHash &commandHash) : commandHash(commandHash) {}
+
+        ShellError execute(const std::vector<char *> &argv) override {
+            if (argv.at(1) == nullptr) {
+                if (commandHash.empty())
+                    std::cout << "hash: hash table empty" << std::endl;
+                else
+                    commandHash.print(std::cout);
+                return ERROR_OK;
+            }
+
+            if (strcmp(argv.at(1), "-r") == 0) {
+                commandHash.clear();
+                return ERROR_OK;
+            }
+
+            bool forget = strcmp(argv.at(1), "-d") == 0;
+            ShellError error = ERROR_OK;
+            for (size_t argNumber = forget ? 2 : 1; argv.at(argNumber) != nullptr; ++argNumber) {
+                if (forget)
+                    commandHash.forget(argv.at(argNumber));
+                else if (!commandHash.resolve(argv.at(argNumber))) {
+                    // Like bash, every missing name is reported
+                    std::cerr << "hash: " << argv.at(argNumber) << ": not found" << std::endl;
+                    error = ERROR_HASH_NOT_FOUND;
+                }
+            }
+
+            return error;
+        }
+
+       private:
+        CommandHash &commandHash;
+    };
+
+    // wait            wait for all background jobs
+    // wait [%]N...    wait for the numbered ones
+    class WaitCommand : public InternalCommand {
+       public:
+        WaitCommand(JobTable &jobs, bool notify) : jobs(jobs), notify(notify) {}
+
+        ShellError execute(const std::vector<char *> &argv) override {
+            ShellError error = ERROR_OK;
+            size_t waited = 0;
+            // Other jobs finishing meanwhile are reported, but only the waited ones give status
+            auto done = [&](const JobTable::Job &job) {
+                if (job.failed && (!waited || job.number == waited))
+                    error = ERROR_STATUS_CHILD;
+                if (notify)
+                    reportJob(job);
+            };
+
+            if (argv.at(1) == nullptr) {
+                while (jobs.size())
+                    jobs.reap(true, done);
+                return error;
+            }
+
+            for (size_t argNumber = 1; argv.at(argNumber) != nullptr; ++argNumber) {
+                const char *number = argv.at(argNumber);
+                if (*number == '%')
+                    ++number;
+                char *end = nullptr;
+                waited = strtoul(number, &end, 10);
+                if (!*number || *end || !jobs.contains(waited)) {
+                    error = ERROR_NO_JOB;
+                    continue;
+                }
+                while (jobs.contains(waited))
+                    jobs.reap(true, done);
+            }
+
+            return error;
+        }
+
+       private:
+        JobTable &jobs;
+        bool notify;
+    };
+
+    // jobs            list background jobs still running
+    class JobsCommand : public InternalCommand {
+       public:
+        JobsCommand(JobTable &jobs, bool notify) : jobs(jobs), notify(notify) {}
+
+        ShellError execute(const std::vector<char *> &argv) override {
+            jobs.reap(false, [this](const JobTable::Job &job) {
+                if (notify)
+                    reportJob(job);
+            });
+            for (const JobTable::Job &job : jobs.running())
+                std::cout << "[" << job.number << "] Running " << job.command << std::endl;
+            return ERROR_OK;
+        }
+
+       private:
+        JobTable &jobs;
+        bool notify;
+    };
+
+    // parallel [-j N] COMMAND [ARGS...] ::: VALUE...
+    // Runs COMMAND ARGS... once for every value, at most N at once (default: number of CPUs).
+    // `{}` in arguments is replaced by the value, without it the value is added as the last argument.
+    class ParallelCommand : public InternalCommand {
+       public:
+        explicit ParallelCommand(Pipeline &pipeline) : pipeline(pipeline) {}
+
+        ShellError execute(const std::vector<char *> &argv) override {
+            size_t limit = 0;
+            size_t first = 1;
+            if (argv.at(1) != nullptr && strncmp(argv.at(1), "-j", 2) == 0) {
+                const char *value = argv.at(1)[2] ? argv.at(1) + 2 : argv.at(2);
+                if (value == nullptr)
+                    return ERROR_PARALLEL_USAGE;
+                first = argv.at(1)[2] ? 2 : 3;
+
+                char *end = nullptr;
+                limit = strtoul(value, &end, 10);
+                if (!*value || *end || limit == 0)
+                    return ERROR_PARALLEL_USAGE;
+            }
+            if (limit == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                limit = cpus > 0 ? (size_t) cpus : 1;
+            }
+
+            size_t separator = first;
+            while (argv.at(separator) != nullptr && strcmp(argv.at(separator), ":::") != 0)
+                ++separator;
+            if (separator == first || argv.at(separator) == nullptr)
+                return ERROR_PARALLEL_USAGE;
+
+            // A child finished is replaced by the next value right away, the slowest one doesn't hold the others
+            ShellError error = ERROR_OK;
+            JobTable running;
+            auto done = [&error](const JobTable::Job &job) {
+                if (job.failed && !error)
+                    error = ERROR_STATUS_CHILD;
+            };
+            for (size_t valueNumber = separator + 1; argv.at(valueNumber) != nullptr; ++valueNumber) {
+                while (running.size() >= limit)
+                    running.reap(true, done);
+
+                buildArguments(argv, first, separator, argv.at(valueNumber));
+                pids.clear();
+                Pipeline::Result result = pipeline.start(&arguments, 1, pids);
+                if (result != Pipeline::RESULT_OK && !error)
+                    error = pipelineError(result);
+                if (!pids.empty())
+                    running.add(std::string(), pids);
+            }
+            while (running.size())
+                running.reap(true, done);
+
+            return error;
+        }
+
+       private:
+        Pipeline &pipeline;
+        std::vector<std::string> words;
+        std::vector<char *> arguments;
+        std::vector<pid_t> pids;
+
+        void buildArguments(const std::vector<char *> &argv, size_t first, size_t separator, const char *value) {
+            bool placed = false;
+            words.clear();
+            for (size_t argNumber = first; argNumber < separator; ++argNumber) {
+                std::string word = argv.at(argNumber);
+                for (size_t at = word.find("{}"); at != std::string::npos; at = word.find("{}", at + strlen(value))) {
+                    word.replace(at, 2, value);
+                    placed = true;
+                }
+                words.push_back(std::move(word));
+            }
+            if (!placed)
+                words.emplace_back(value);
+
+            arguments.clear();
+            for (std::string &word : words)
+                arguments.push_back(&word[0]);
+            arguments.push_back(nullptr);
+        }
+    };
+
+    // Line of script every command comes from
+    struct ScriptLine {
+        size_t number;
+        size_t offset;
+        size_t length;
+    };
 
-    static std::unique_ptr<InternalCommand> getCommandObject(CommandNumber commandNumber) {
+    std::string currentLine;
+    // Text of line for error messages, the line itself is split in place
+    std::string lineText;
+    std::string scriptText;
+    std::vector<ScriptLine> scriptLines;
+    Tokenizer tokenizer;
+    CommandHash commandHash;
+    Pipeline pipeline {Pipeline::MODE_SPAWN, &commandHash};
+    JobTable jobs;
+    std::vector<pid_t> jobPids;
+    // Jobs are reported in line mode like an interactive shell, scripts stay quiet
+    bool notify = false;
+
+    std::unique_ptr<InternalCommand> getCommandObject(CommandNumber commandNumber) {
         switch (commandNumber) {
             case CD:
                 return std::unique_ptr<CDcommand>(new CDcommand());
             case EXIT:
                 return std::unique_ptr<ExitCommand>(new ExitCommand());
+            case HASH:
+                return std::unique_ptr<HashCommand>(new HashCommand(commandHash));
+            case WAIT:
+                return std::unique_ptr<WaitCommand>(new WaitCommand(jobs, notify));
+            case JOBS:
+                return std::unique_ptr<JobsCommand>(new JobsCommand(jobs, notify));
+            case PARALLEL:
+                return std::unique_ptr<ParallelCommand>(new ParallelCommand(pipeline));
             default:
                 return nullptr;
         }
@@ -99,128 +361,145 @@ class Shell {
 
     static CommandNumber internalCommand(const std::vector<char *> &command) {
         char *commandName = command.at(0);
-        for (size_t commandNumber = 1; commandNumber < NUMBER_COMMANDS; commandNumber++)
-            if (strcmp(commandName, COMMANDS[commandNumber].name) == 0)
-                return COMMANDS[commandNumber].commandNum;
+        size_t commandNumber = BUILTIN_SLOTS.index[builtin::slot(commandName)];
+        if (commandNumber && strcmp(commandName, COMMANDS[commandNumber].name) == 0)
+            return COMMANDS[commandNumber].commandNum;
 
         return NONE;
     }
 
+    // Line and argument lists keep their capacity for the next line
     void clearMem() {
         currentLine.clear();
-        words.clear();
-        argv.clear();
-        numberPrograms = 0;
     }
 
-    void splitSentence(const std::string &currentLine) {
-        std::stringstream ss(currentLine);
-        std::string word;
-
-        for (size_t argc = 0; ss >> word; ++argc) {
-            words.push_back(std::move(word));
-        }
-
-        std::vector<char *> firstProgram;
-        argv.push_back(std::move(firstProgram));
-        for (auto &string : words) {
-            if (string == "|") {
-                argv.at(numberPrograms).push_back(nullptr);
-
-                std::vector<char *> nextProgram;
-                argv.push_back(std::move(nextProgram));
-                ++numberPrograms;
-            } else {
-                argv.at(numberPrograms).push_back(string.data());
-            }
-        }
-
-        argv.at(numberPrograms).push_back(nullptr);
-        ++numberPrograms;
+    ShellError executeExternalCommands(size_t firstStage, size_t stages) {
+        return pipelineError(pipeline.run(&tokenizer.stage(firstStage), stages));
     }
 
-    ShellError executeExternalCommands() {
-        int pipes[numberPrograms][2];
-
-        for (size_t pipeIndex = 0; pipeIndex < numberPrograms; pipeIndex++)
-            pipe(pipes[pipeIndex]);
-
-        pid_t pids[numberPrograms];
-        for (size_t programNumber = 0; programNumber < numberPrograms; ++programNumber) {
-            pid_t pid;
-
-            if ((pid = fork()) < 0) {
-                return ERROR_FORK;
-            }
-
-            if (pid == 0) {
-                if (programNumber > 0)
-                    dup2(pipes[programNumber - 1][0], STDIN_FILENO);
-                if (programNumber + 1 < numberPrograms)
-                    dup2(pipes[programNumber][1], STDOUT_FILENO);
-
-                closePrevPipes(pipes, programNumber);
-
-                if (execvp(argv.at(programNumber).at(0), argv.at(programNumber).data()) < 0)
-                    return ERROR_EXEC_CHILD;
-            } else {
-                pids[programNumber] = pid;
+    // Background pipeline is added to the job table, named by its words
+    ShellError startJob(const Tokenizer::Command &command) {
+        jobPids.clear();
+        Pipeline::Result result = pipeline.start(&tokenizer.stage(command.firstStage), command.stages, jobPids);
+        if (!jobPids.empty()) {
+            std::string name;
+            for (size_t stage = command.firstStage; stage < command.firstStage + command.stages; ++stage) {
+                if (stage != command.firstStage)
+                    name += " |";
+                for (char **word = tokenizer.stage(stage).data(); *word; ++word)
+                    name.append(name.empty() ? "" : " ").append(*word);
             }
-        }
-
-        closePrevPipes(pipes, numberPrograms);
 
-        for (size_t processNumber = 0; processNumber < numberPrograms; ++processNumber) {
-            int status = 0;
-            waitpid(pids[processNumber], &status, 0);
-            if (status)
-                return ERROR_STATUS_CHILD;
+            size_t number = jobs.add(std::move(name), jobPids);
+            if (notify)
+                std::cerr << "[" << number << "] " << jobPids.back() << std::endl;
         }
 
-        return ERROR_OK;
+        return pipelineError(result);
     }
 
-    static void closePrevPipes(int pipes[][2], int numberChannels) {
-        for (int channelNumber = 0; channelNumber < numberChannels; ++channelNumber) {
-            close(pipes[channelNumber][0]);
-            close(pipes[channelNumber][1]);
-        }
+    // Finished background jobs are reaped between commands, so they don't stay zombies
+    void reapJobs() {
+        if (jobs.size())
+            jobs.reap(false, [this](const JobTable::Job &job) {
+                if (notify)
+                    reportJob(job);
+            });
     }
 
-    bool processLine() {
-        if (std::getline(std::cin, currentLine, '\n') && currentLine.size()) {
-            splitSentence(currentLine);
-            return true;
+    static ShellError tokenizeError(Tokenizer::Result result) {
+        switch (result) {
+            case Tokenizer::TOKENIZE_OK:
+                return ERROR_OK;
+            case Tokenizer::TOKENIZE_UNTERMINATED_QUOTE:
+                return ERROR_UNTERMINATED_QUOTE;
+            default:
+                return ERROR_EMPTY_STAGE;
         }
+    }
 
-        return false;
+    void printScriptError(const char *name, const ScriptLine &line, ShellError error) {
+        lineText.assign(scriptText, line.offset, line.length);
+        std::cerr << name << ":" << line.number << ": ";
+        print_error(lineText, error);
     }
 
-    ShellError executeCommand() {
+    // Builtins run in the shell itself, also when they end with `&`
+    ShellError executeCommand(const Tokenizer::Command &command) {
         ShellError error = ERROR_OK;
-        if (CommandNumber command = internalCommand(argv.at(0))) {
-            std::unique_ptr<InternalCommand> commandObject = getCommandObject(command);
+        if (CommandNumber number = internalCommand(tokenizer.stage(command.firstStage))) {
+            std::unique_ptr<InternalCommand> commandObject = getCommandObject(number);
             if (!commandObject)
                 return ERROR_GET_INTERNAL;
 
-            error = commandObject->execute(argv.at(0));
+            error = commandObject->execute(tokenizer.stage(command.firstStage));
+        } else if (command.background) {
+            error = startJob(command);
         } else {
-            error = executeExternalCommands();
+            error = executeExternalCommands(command.firstStage, command.stages);
         }
 
         return error;
     }
 
    public:
-    void execute() {
-        if (!processLine())
-            return;
-
-        ShellError error = executeCommand();
+    // Run one line of standard input, returns false at its end
+    bool execute() {
+        notify = true;
+        if (!std::getline(std::cin, currentLine, '\n'))
+            return false;
+
+        lineText = currentLine;
+        ShellError error = tokenizeError(tokenizer.split(&currentLine[0], currentLine.size()));
         if (error) {
-            print_error(error);
+            print_error(lineText, error);
+        }
+
+        for (size_t index = 0; !error && index < tokenizer.commandCount(); ++index) {
+            if (ShellError commandError = executeCommand(tokenizer.command(index)))
+                print_error(lineText, commandError);
         }
 
+        reapJobs();
         clearMem();
+        return true;
+    }
+
+    // Parse the whole script, then run its commands without prompt; errors are prefixed by name and line number.
+    // Script must end with '\0' at length, it's split in place. Nothing runs if script has a syntax error.
+    // Returns false on syntax error or when the last command failed.
+    bool executeScript(const char *name, char *script, size_t length) {
+        notify = false;
+        tokenizer.clear();
+        scriptLines.clear();
+        scriptText.assign(script, length);
+
+        char *end = script + length;
+        size_t lineNumber = 0;
+        for (char *line = script; line < end; ++lineNumber) {
+            char *newline = static_cast<char *>(memchr(line, '\n', (size_t) (end - line)));
+            size_t lineLength = newline ? (size_t) (newline - line) : (size_t) (end - line);
+            line[lineLength] = '\0';
+
+            ScriptLine scriptLine {lineNumber + 1, (size_t) (line - script), lineLength};
+            ShellError error = tokenizeError(tokenizer.append(line, lineLength));
+            if (error) {
+                printScriptError(name, scriptLine, error);
+                return false;
+            }
+            scriptLines.resize(tokenizer.commandCount(), scriptLine);
+
+            line += lineLength + 1;
+        }
+
+        ShellError error = ERROR_OK;
+        for (size_t index = 0; index < tokenizer.commandCount(); ++index) {
+            error = executeCommand(tokenizer.command(index));
+            if (error)
+                printScriptError(name, scriptLines[index], error);
+            reapJobs();
+        }
+
+        return error == ERROR_OK;
     }
 };
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Splits command line into arguments of pipeline stages in one pass over the line buffer.
+// Words are unquoted and terminated in place and arguments point into the line, so no word is copied;
+// argument lists of stages keep their capacity between lines, so nothing is allocated once it has grown.
+//
+//   'text'   literal text
+//   "text"   text where \" and \\ are escapes
+//   \c       literal character c
+//   |        ends stage, also without spaces around it (a|b)
+//   &        ends command that runs in background, the next command may follow on the same line
+//   #        at the start of word begins comment up to the end of line
+//
+// Lines of script are appended one after another, so the whole script is parsed before it runs.
+class Tokenizer {
+   public:
+    enum Result { TOKENIZE_OK = 0, TOKENIZE_UNTERMINATED_QUOTE = 1, TOKENIZE_EMPTY_STAGE = 2 };
+
+    // Pipeline of stages [firstStage, firstStage + stages)
+    struct Command {
+        size_t firstStage;
+        size_t stages;
+        bool background;
+    };
+
+    // Line must end with '\0' at length, it's overwritten by unquoted words
+    Result split(char *line, size_t length) {
+        clear();
+        return append(line, length);
+    }
+
+    void clear() {
+        count = 0;
+        tokens = 0;
+        commands.clear();
+    }
+
+    // Add commands of line after the commands already split, blank line adds none
+    Result append(char *line, size_t length) {
+        size_t first = count;
+        beginStage();
+
+        size_t read = 0;
+        size_t write = 0;
+        char *word = nullptr;
+        while (read < length) {
+            char c = line[read++];
+
+            if (c == ' ' || c == '\t' || c == '\r' || c == '|' || c == '&') {
+                // Terminator takes the place of the consumed character, so write never passes read
+                if (word) {
+                    line[write++] = '\0';
+                    addWord(word);
+                    word = nullptr;
+                }
+                if (c == '|' || c == '&') {
+                    if (stages[count - 1].empty())
+                        return TOKENIZE_EMPTY_STAGE;
+                    endStage();
+                    if (c == '&') {
+                        endCommand(first, true);
+                        first = count;
+                    }
+                    beginStage();
+                }
+                continue;
+            }
+
+            if (c == '#' && !word)
+                break;
+
+            if (!word)
+                word = line + write;
+
+            if (c == '\\') {
+                if (read < length)
+                    line[write++] = line[read++];
+            } else if (c == '\'') {
+                while (read < length && line[read] != '\'')
+                    line[write++] = line[read++];
+                if (read++ == length)
+                    return TOKENIZE_UNTERMINATED_QUOTE;
+            } else if (c == '"') {
+                while (read < length && line[read] != '"') {
+                    if (line[read] == '\\' && read + 1 < length && (line[read + 1] == '"' || line[read + 1] == '\\'))
+                        ++read;
+                    line[write++] = line[read++];
+                }
+                if (read++ == length)
+                    return TOKENIZE_UNTERMINATED_QUOTE;
+            } else {
+                line[write++] = c;
+            }
+        }
+
+        if (word) {
+            line[write] = '\0';
+            addWord(word);
+        }
+        if (!stages[count - 1].empty()) {
+            endStage();
+            endCommand(first, false);
+        } else if (count > first + 1) {
+            // Trailing `|` leaves empty stage
+            return TOKENIZE_EMPTY_STAGE;
+        } else {
+            // Blank line, comment or trailing `&` has no more stages
+            count = first;
+        }
+
+        return TOKENIZE_OK;
+    }
+
+    size_t stageCount() const {
+        return count;
+    }
+
+    size_t tokenCount() const {
+        return tokens;
+    }
+
+    size_t commandCount() const {
+        return commands.size();
+    }
+
+    const Command &command(size_t index) const {
+        return commands.at(index);
+    }
+
+    // Null-terminated arguments of stage
+    std::vector<char *> &stage(size_t index) {
+        return stages.at(index);
+    }
+
+   private:
+    std::vector<std::vector<char *>> stages;
+    std::vector<Command> commands;
+    size_t count = 0;
+    size_t tokens = 0;
+
+    void beginStage() {
+        if (count == stages.size())
+            stages.emplace_back();
+        stages[count++].clear();
+    }
+
+    void addWord(char *word) {
+        stages[count - 1].push_back(word);
+        ++tokens;
+    }
+
+    void endStage() {
+        stages[count - 1].push_back(nullptr);
+    }
+
+    void endCommand(size_t first, bool background) {
+        commands.push_back({first, count - first, background});
+    }
+};